@@ -92,6 +92,9 @@ Atom & Atom::operator=(const Atom & x){
 	else if (x.m_type == DiscreteKind) {
 		setDiscrete();
 	}
+	else if (x.m_type == FutureKind) {
+		setFuture();
+	}
   }
   return *this;
 }
@@ -136,6 +139,10 @@ bool Atom::isDiscrete() const noexcept {
 	return m_type == DiscreteKind;
 }
 
+bool Atom::isFuture() const noexcept {
+	return m_type == FutureKind;
+}
+
 void Atom::setNumber(double value){
 
   m_type = NumberKind;
@@ -183,6 +190,10 @@ void Atom::setDiscrete() {
 	m_type = DiscreteKind;
 }
 
+void Atom::setFuture() {
+	m_type = FutureKind;
+}
+
 double Atom::asNumber() const noexcept{
 
   return (m_type == NumberKind) ? numberValue : 0.0;  
@@ -276,6 +287,11 @@ bool Atom::operator==(const Atom & right) const noexcept{
 	  if (right.m_type != DiscreteKind) return false;
   }
   break;
+  case FutureKind:
+  {
+	  if (right.m_type != FutureKind) return false;
+  }
+  break;
   default:
     return false;
   }
@@ -303,5 +319,8 @@ std::ostream & operator<<(std::ostream & out, const Atom & a){
   if (a.isString()) {
 	  out << a.asString();
   }
+  if (a.isFuture()) {
+	  out << "<future>";
+  }
   return out;
 }
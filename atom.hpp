@@ -63,6 +63,9 @@ public:
   /// predicate to determine if an Atom is of type Discrete
   bool isDiscrete() const noexcept;
 
+  /// predicate to determine if an Atom is of type Future
+  bool isFuture() const noexcept;
+
   /// value of Atom as a number, return 0 if not a Number
   double asNumber() const noexcept;
 
@@ -87,10 +90,13 @@ public:
   // helper to set type of Discrete
   void setDiscrete();
 
+  // helper to set type of Future
+  void setFuture();
+
 private:
 
   // internal enum of known types
-  enum Type {NoneKind, NumberKind, SymbolKind, ComplexKind, ListKind, LambdaKind, StringKind, DiscreteKind};
+  enum Type {NoneKind, NumberKind, SymbolKind, ComplexKind, ListKind, LambdaKind, StringKind, DiscreteKind, FutureKind};
 
   // track the type
   Type m_type;
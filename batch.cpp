@@ -0,0 +1,72 @@
+#include "batch.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "semantic_error.hpp"
+
+// read, parse and evaluate one file on its own clone of startup
+static void run_file(const Interpreter & startup, BatchResult & result, const CancelToken & token) {
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  Interpreter interp = startup.clone();
+
+  std::ifstream ifs(result.file);
+  if (!ifs) {
+    result.output = "Error: Could not open file for reading.";
+  }
+  else if (!interp.parseStream(ifs)) {
+    result.output = "Error: Invalid Program. Could not parse.";
+  }
+  else {
+    try {
+      std::ostringstream out;
+      out << interp.evaluate(token);
+      result.output = out.str();
+      result.ok = true;
+    }
+    catch (const SemanticError & ex) {
+      result.output = ex.what();
+    }
+    catch (const std::exception & ex) {
+      // a file that runs out of memory fails alone rather than ending the batch
+      result.output = std::string("Error: ") + ex.what();
+    }
+  }
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  result.milliseconds = elapsed.count();
+}
+
+std::vector<BatchResult> run_batch(const Interpreter & startup, const std::vector<std::string> & files,
+  unsigned kernels, const CancelToken & token) {
+
+  std::vector<BatchResult> results(files.size());
+  for (std::size_t i = 0; i < files.size(); i++) {
+    results[i].file = files[i];
+  }
+
+  if (kernels == 0) kernels = 1;
+  if (kernels > files.size()) kernels = static_cast<unsigned>(files.size());
+
+  // each kernel takes the next file not yet claimed until none are left
+  std::atomic<std::size_t> next(0);
+  std::vector<std::thread> threads;
+  for (unsigned k = 0; k < kernels; k++) {
+    threads.emplace_back([&startup, &results, &next, &token, k]() {
+      for (std::size_t i = next++; i < results.size(); i = next++) {
+        results[i].kernel = k;
+        run_file(startup, results[i], token);
+      }
+    });
+  }
+  for (auto & thread : threads) {
+    thread.join();
+  }
+
+  return results;
+}
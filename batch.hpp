@@ -0,0 +1,53 @@
+/*! \file batch.hpp
+Defines the batch runner, which evaluates many program files on a few
+interpreter kernels that all start from one evaluated startup environment.
+ */
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <string>
+#include <vector>
+
+#include "interpreter.hpp"
+#include "cancel.hpp"
+
+/*! \struct BatchResult
+\brief The outcome of evaluating one file of a batch.
+ */
+struct BatchResult {
+
+  BatchResult(): ok(false), milliseconds(0), kernel(0) {}
+
+  /// the path of the program file
+  std::string file;
+
+  /// the printed result, or the error message when ok is false
+  std::string output;
+
+  /// true if the file was read, parsed and evaluated without error
+  bool ok;
+
+  /// the time taken to read, parse and evaluate the file
+  double milliseconds;
+
+  /// the kernel that evaluated the file, counting from zero
+  unsigned kernel;
+};
+
+/*! Evaluate each of files on a fresh copy of startup.
+
+  Kernels threads take the files in turn, so one long program does not hold
+  up the others. Each file starts from the environment startup had after its
+  startup program, without the definitions of files evaluated before it, and
+  runs under the limits set on startup.
+
+  \param startup the interpreter the kernels are cloned from
+  \param files the program files to evaluate
+  \param kernels the number of files evaluated at a time, at least one
+  \param token cancels the whole batch, files not yet started fail at once
+  \return a result for each file, in the order of files
+ */
+std::vector<BatchResult> run_batch(const Interpreter & startup, const std::vector<std::string> & files,
+  unsigned kernels, const CancelToken & token);
+
+#endif
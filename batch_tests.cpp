@@ -0,0 +1,85 @@
+#include "catch.hpp"
+
+#include "batch.hpp"
+#include "interpreter.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// write program to a scratch file, returning its name
+static std::string scratch(const std::string & name, const std::string & program) {
+	std::string file = "batch_tests_" + name + ".pls";
+	std::ofstream out(file);
+	out << program;
+	return file;
+}
+
+TEST_CASE("Test a batch of files on several kernels", "[batch]") {
+	Interpreter startup;
+	std::istringstream definitions("(define twice (lambda (x) (* 2 x)))");
+	REQUIRE(startup.parseStream(definitions));
+	startup.evaluate();
+
+	std::vector<std::string> files;
+	for (int i = 0; i < 8; i++) {
+		files.push_back(scratch(std::to_string(i), "(begin (define y " + std::to_string(i) + ") (twice y))"));
+	}
+	files.push_back(scratch("unknown", "(+ y 1)"));
+	files.push_back(scratch("unparsed", "(+ 1"));
+	files.push_back("batch_tests_missing.pls");
+
+	std::vector<BatchResult> results = run_batch(startup, files, 3, CancelToken());
+	REQUIRE(results.size() == files.size());
+	for (int i = 0; i < 8; i++) {
+		REQUIRE(results[i].file == files[i]);
+		REQUIRE(results[i].ok);
+		REQUIRE(results[i].output == "(" + std::to_string(2 * i) + ")");
+		REQUIRE(results[i].kernel < 3);
+	}
+
+	// definitions made by one file are not seen by the next
+	REQUIRE(!results[8].ok);
+	REQUIRE(results[8].output == "Error during evaluation: unknown symbol");
+	REQUIRE(!results[9].ok);
+	REQUIRE(!results[10].ok);
+
+	for (auto & file : files) {
+		std::remove(file.c_str());
+	}
+}
+
+TEST_CASE("Test files in a batch do not share memoized results", "[batch]") {
+	Interpreter startup;
+	startup.setAutoMemoize(true);
+
+	// the same pure lambda in both files, a shared cache would answer the
+	// second file's calls from the first file's entries
+	std::string program = "(begin (define sq (lambda (x) (* x x))) (sq 3) (sq 3) (first (memo-stats)))";
+	std::vector<std::string> files = { scratch("first", program), scratch("second", program) };
+
+	std::vector<BatchResult> results = run_batch(startup, files, 1, CancelToken());
+	REQUIRE(results[0].output == "(1)");
+	REQUIRE(results[1].output == "(1)");
+	REQUIRE(startup.memoStats().entries == 0);
+
+	for (auto & file : files) {
+		std::remove(file.c_str());
+	}
+}
+
+TEST_CASE("Test cancelling a batch", "[batch]") {
+	Interpreter startup;
+	std::vector<std::string> files = { scratch("cancelled", "(+ 1 2)") };
+
+	CancelToken token;
+	token.cancel();
+	std::vector<BatchResult> results = run_batch(startup, files, 2, token);
+	REQUIRE(results.size() == 1);
+	REQUIRE(!results[0].ok);
+	REQUIRE(results[0].output == "Error: interpreter kernel interrupted");
+
+	std::remove(files[0].c_str());
+}
@@ -0,0 +1,88 @@
+#include "budget.hpp"
+
+thread_local Budget * current_budget = nullptr;
+
+static std::string limit_message(LimitError::Kind kind, std::uint64_t limit) {
+
+  std::string amount = std::to_string(limit);
+  switch (kind) {
+  case LimitError::Steps:
+    return "Error during evaluation: step limit of " + amount + " exceeded";
+  case LimitError::Time:
+    return "Error during evaluation: time limit of " + amount + " ms exceeded";
+  default:
+    return "Error during evaluation: memory limit of " + amount + " bytes exceeded";
+  }
+}
+
+LimitError::LimitError(Kind kind, std::uint64_t limit):
+  SemanticError(limit_message(kind, limit)), m_kind(kind) {}
+
+Budget::Budget(const Limits & limits):
+  m_limits(limits), m_deadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(limits.milliseconds)),
+  m_steps(0), m_bytes(0), m_overdrawn(false) {}
+
+void Budget::check(std::uint64_t taken) const {
+
+  if (m_limits.steps && taken > m_limits.steps) {
+    throw LimitError(LimitError::Steps, m_limits.steps);
+  }
+  if (m_overdrawn.load(std::memory_order_relaxed)) {
+    throw LimitError(LimitError::Memory, m_limits.bytes);
+  }
+  if (m_limits.milliseconds && std::chrono::steady_clock::now() >= m_deadline) {
+    throw LimitError(LimitError::Time, m_limits.milliseconds);
+  }
+}
+
+bool Budget::charge(std::uint64_t bytes) noexcept {
+
+  std::int64_t held = m_bytes.fetch_add(static_cast<std::int64_t>(bytes), std::memory_order_relaxed) +
+    static_cast<std::int64_t>(bytes);
+  if (m_limits.bytes && held > static_cast<std::int64_t>(m_limits.bytes)) {
+    m_overdrawn.store(true, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+void Budget::require(std::uint64_t bytes) const {
+
+  if (!m_limits.bytes) {
+    return;
+  }
+  std::int64_t held = m_bytes.load(std::memory_order_relaxed);
+  if (bytes > m_limits.bytes || held + static_cast<std::int64_t>(bytes) > static_cast<std::int64_t>(m_limits.bytes)) {
+    throw LimitError(LimitError::Memory, m_limits.bytes);
+  }
+}
+
+void Budget::release(std::uint64_t bytes) noexcept {
+
+  // storage made before the budget started may be freed under it, never
+  // going below zero keeps that from paying for later allocations
+  std::int64_t held = m_bytes.load(std::memory_order_relaxed);
+  std::int64_t left;
+  do {
+    left = held > static_cast<std::int64_t>(bytes) ? held - static_cast<std::int64_t>(bytes) : 0;
+  } while (!m_bytes.compare_exchange_weak(held, left, std::memory_order_relaxed));
+}
+
+std::shared_ptr<Budget> Budget::current() {
+
+  if (current_budget) {
+    return current_budget->shared_from_this();
+  }
+  return std::shared_ptr<Budget>();
+}
+
+BudgetScope::BudgetScope(const std::shared_ptr<Budget> & budget) noexcept:
+  m_budget(budget), m_previous(current_budget) {
+
+  current_budget = m_budget.get();
+}
+
+BudgetScope::~BudgetScope() {
+
+  current_budget = m_previous;
+}
@@ -0,0 +1,140 @@
+/*! \file budget.hpp
+Defines the limits on the steps, time and memory one evaluation may use,
+and the state that enforces them while the evaluation runs.
+ */
+#ifndef BUDGET_HPP
+#define BUDGET_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "semantic_error.hpp"
+
+/*! \struct Limits
+\brief The most one evaluation may use, zero means no limit.
+ */
+struct Limits {
+
+  Limits(): steps(0), milliseconds(0), bytes(0) {}
+
+  /// the number of expressions evaluated
+  std::uint64_t steps;
+
+  /// the wall-clock time from the start of the evaluation
+  std::uint64_t milliseconds;
+
+  /// the bytes held by the lists made during the evaluation and still alive
+  std::uint64_t bytes;
+};
+
+/*! \class LimitError
+\brief The SemanticError thrown when an evaluation exceeds one of its limits.
+ */
+class LimitError: public SemanticError {
+public:
+
+  /// the limit that was exceeded
+  enum Kind {Steps, Time, Memory};
+
+  /// Construct the error for limit kind, which was set to limit
+  LimitError(Kind kind, std::uint64_t limit);
+
+  /// the limit that was exceeded
+  Kind kind() const noexcept { return m_kind; }
+
+private:
+  Kind m_kind;
+};
+
+/*! \class Budget
+\brief What is left of the limits of one running evaluation.
+
+An evaluation runs under a budget with a BudgetScope. Each evaluation step
+calls step(), which throws a LimitError once the steps, the deadline or the
+memory are exhausted. Memory is charged when list storage is made and
+released when it is freed; a charge never throws, since it may happen in
+code that cannot, and is noticed at the next step. Tasks an evaluation hands
+to the thread pool share its budget.
+ */
+class Budget: public std::enable_shared_from_this<Budget> {
+public:
+
+  /// Start a budget with limits, the deadline counts from now
+  explicit Budget(const Limits & limits);
+
+  Budget(const Budget &) = delete;
+  Budget & operator=(const Budget &) = delete;
+
+  /// count one evaluation step
+  /// \throws LimitError when a limit is exceeded
+  void step() {
+    std::uint64_t taken = m_steps.fetch_add(1, std::memory_order_relaxed) + 1;
+    if ((m_limits.steps && taken > m_limits.steps) || (taken % clock_interval) == 0 ||
+      m_overdrawn.load(std::memory_order_relaxed)) {
+      check(taken);
+    }
+  }
+
+  /// throw if a limit is already exceeded, without counting a step
+  void check() const { check(m_steps.load(std::memory_order_relaxed)); }
+
+  /// count bytes of new list storage, false if that exceeds the memory limit
+  bool charge(std::uint64_t bytes) noexcept;
+
+  /// check bytes more can be charged before allocating them
+  /// \throws LimitError if that would exceed the memory limit
+  void require(std::uint64_t bytes) const;
+
+  /// count bytes of list storage as freed, the count never goes below zero
+  void release(std::uint64_t bytes) noexcept;
+
+  /// the steps taken so far
+  std::uint64_t steps() const noexcept { return m_steps.load(std::memory_order_relaxed); }
+
+  /// the budget of the evaluation running on this thread, or null
+  static std::shared_ptr<Budget> current();
+
+private:
+
+  // steps between looks at the clock
+  static const std::uint64_t clock_interval = 1024;
+
+  void check(std::uint64_t taken) const;
+
+  Limits m_limits;
+  std::chrono::steady_clock::time_point m_deadline;
+  std::atomic<std::uint64_t> m_steps;
+  std::atomic<std::int64_t> m_bytes;
+  std::atomic<bool> m_overdrawn;
+};
+
+/*! \class BudgetScope
+\brief Runs the rest of a block on the calling thread under a budget.
+
+Scopes nest, the previous budget is restored when the scope ends. A null
+budget runs without limits.
+ */
+class BudgetScope {
+public:
+
+  /// make budget the budget of the calling thread
+  explicit BudgetScope(const std::shared_ptr<Budget> & budget) noexcept;
+
+  /// restore the budget the thread had before
+  ~BudgetScope();
+
+  BudgetScope(const BudgetScope &) = delete;
+  BudgetScope & operator=(const BudgetScope &) = delete;
+
+private:
+  std::shared_ptr<Budget> m_budget;
+  Budget * m_previous;
+};
+
+// the budget of the innermost scope on the calling thread, null outside any
+extern thread_local Budget * current_budget;
+
+#endif
@@ -0,0 +1,127 @@
+#include "catch.hpp"
+
+#include "budget.hpp"
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+#include "sequence.hpp"
+
+#include <sstream>
+#include <string>
+
+// evaluate program with limits, returning the kind of limit it exceeded
+static LimitError::Kind exceeded(const std::string & program, const Limits & limits) {
+	Interpreter interp;
+	interp.setLimits(limits);
+	std::istringstream iss(program);
+	REQUIRE(interp.parseStream(iss));
+	try {
+		interp.evaluate();
+	}
+	catch (const LimitError & ex) {
+		return ex.kind();
+	}
+	FAIL("no limit was exceeded");
+	return LimitError::Steps;
+}
+
+TEST_CASE("Test a budget counts steps", "[budget]") {
+	Limits limits;
+	limits.steps = 10;
+	Budget budget(limits);
+	for (int i = 0; i < 10; i++) {
+		REQUIRE_NOTHROW(budget.step());
+	}
+	REQUIRE_THROWS_AS(budget.step(), LimitError);
+	REQUIRE(budget.steps() == 11);
+}
+
+TEST_CASE("Test a budget notices memory at the next step", "[budget]") {
+	Limits limits;
+	limits.bytes = 1000;
+	Budget budget(limits);
+	REQUIRE(budget.charge(600));
+	REQUIRE_NOTHROW(budget.require(400));
+	REQUIRE_THROWS_AS(budget.require(401), LimitError);
+	budget.release(600);
+	REQUIRE(budget.charge(900));
+	REQUIRE_NOTHROW(budget.step());
+
+	REQUIRE(!budget.charge(200));
+	try {
+		budget.step();
+		FAIL("the memory limit was not enforced");
+	}
+	catch (const LimitError & ex) {
+		REQUIRE(ex.kind() == LimitError::Memory);
+		REQUIRE(std::string(ex.what()) == "Error during evaluation: memory limit of 1000 bytes exceeded");
+	}
+}
+
+TEST_CASE("Test releasing more than was charged", "[budget]") {
+	Limits limits;
+	limits.bytes = 1000;
+	Budget budget(limits);
+	// storage made before the budget started, freed under it
+	budget.release(5000);
+	REQUIRE_THROWS_AS(budget.require(1001), LimitError);
+	REQUIRE(!budget.charge(1001));
+}
+
+TEST_CASE("Test a lazy list too big to materialize throws at once", "[budget]") {
+	Limits limits;
+	limits.bytes = 1 << 20;
+	BudgetScope scope(std::make_shared<Budget>(limits));
+
+	Expression lazy = Expression::fromSequence(RangeSequence::make(0, 1e6, 1));
+	REQUIRE_THROWS_AS(lazy.tailConstBegin(), LimitError);
+	REQUIRE(lazy.isLazy());
+	REQUIRE(lazy.tailSize() == 1000001);
+	REQUIRE_THROWS_AS(lazy == lazy, LimitError);
+
+	// a list that fits is produced and charged
+	Expression small = Expression::fromSequence(RangeSequence::make(0, 9, 1));
+	REQUIRE(small.tailConstEnd() - small.tailConstBegin() == 10);
+	REQUIRE(!small.isLazy());
+	REQUIRE_NOTHROW(current_budget->check());
+}
+
+TEST_CASE("Test evaluation limits", "[budget]") {
+	std::string loop = "(begin (define f (lambda (acc x) (+ acc x))) (fold-range f 0 0 1e9 1))";
+
+	Limits steps;
+	steps.steps = 10000;
+	REQUIRE(exceeded(loop, steps) == LimitError::Steps);
+
+	Limits time;
+	time.milliseconds = 20;
+	REQUIRE(exceeded(loop, time) == LimitError::Time);
+
+	Limits memory;
+	memory.bytes = 1 << 20;
+	REQUIRE(exceeded("(begin (define sq (lambda (x) (* x x))) (map sq (range 0 1e7 1)))", memory) == LimitError::Memory);
+	REQUIRE(exceeded("(reverse (range 0 1e8 1))", memory) == LimitError::Memory);
+	REQUIRE(exceeded("(join (range 0 1e6 1) (list 1))", memory) == LimitError::Memory);
+	REQUIRE(exceeded("(discrete-plot (range 0 1e6 1) (list))", memory) == LimitError::Memory);
+}
+
+TEST_CASE("Test evaluations within their limits", "[budget]") {
+	Interpreter interp;
+	Limits limits;
+	limits.steps = 1000;
+	limits.milliseconds = 10000;
+	limits.bytes = 1 << 20;
+	interp.setLimits(limits);
+	REQUIRE(interp.limits().steps == 1000);
+
+	// each evaluation starts with the whole budget
+	for (int i = 0; i < 3; i++) {
+		std::istringstream iss("(begin (define sq (lambda (x) (* x x))) (foldl + 0 (map sq (range 0 99 1))))");
+		REQUIRE(interp.parseStream(iss));
+		REQUIRE(interp.evaluate() == Expression(328350.));
+	}
+
+	// a limit is a SemanticError to hosts that do not look for it
+	std::istringstream iss("(fold-range + 0 0 1e6 1)");
+	REQUIRE(interp.parseStream(iss));
+	REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+}
@@ -0,0 +1,56 @@
+#include "cancel.hpp"
+
+#include "budget.hpp"
+#include "semantic_error.hpp"
+
+thread_local const CancelToken * current_cancel_token = nullptr;
+
+CancelToken::CancelToken(): m_state(std::make_shared<State>(nullptr)) {}
+
+CancelToken::CancelToken(const std::shared_ptr<State> & state): m_state(state) {}
+
+void CancelToken::cancel() const noexcept {
+
+  if (m_state) {
+    m_state->cancelled.store(true, std::memory_order_relaxed);
+  }
+}
+
+CancelToken CancelToken::child() const {
+
+  return CancelToken(std::make_shared<State>(m_state));
+}
+
+CancelToken CancelToken::current() noexcept {
+
+  if (current_cancel_token) {
+    return *current_cancel_token;
+  }
+  return CancelToken(std::shared_ptr<State>());
+}
+
+CancelToken::operator bool() const noexcept {
+
+  return static_cast<bool>(m_state);
+}
+
+void CancelPoll::check() {
+
+  if (cancellation_requested()) {
+    throw SemanticError("Error: interpreter kernel interrupted");
+  }
+  if (current_budget) {
+    current_budget->check();
+  }
+}
+
+CancelScope::CancelScope(const CancelToken & token) noexcept:
+  m_token(token), m_previous(current_cancel_token) {
+
+  current_cancel_token = &m_token;
+}
+
+CancelScope::~CancelScope() {
+
+  current_cancel_token = m_previous;
+}
@@ -0,0 +1,129 @@
+/*! \file cancel.hpp
+Defines the tokens that cancel one evaluation without affecting any other
+evaluation running in the same process.
+ */
+#ifndef CANCEL_HPP
+#define CANCEL_HPP
+
+#include <atomic>
+#include <memory>
+
+/*! \class CancelToken
+\brief A flag shared by every copy, set once to cancel an evaluation.
+
+A host makes a token for each request it submits and keeps a copy. The
+evaluation runs under the token with a CancelScope and stops with an
+interrupted error at its next check once cancel() is called, or does not
+start at all if the request is still queued. Tasks an evaluation hands to
+the thread pool run under the same token.
+
+A child token is cancelled with its parent but can also be cancelled on its
+own, so a part of an evaluation can be stopped without stopping the rest.
+ */
+class CancelToken {
+public:
+
+  /// Construct a token that is not cancelled
+  CancelToken();
+
+  /// cancel the evaluation running under this token or any copy of it
+  void cancel() const noexcept;
+
+  /// true once cancel was called on any copy, or on any copy of a parent
+  bool cancelled() const noexcept {
+    for (const State * state = m_state.get(); state; state = state->parent.get()) {
+      if (state->cancelled.load(std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// a new token cancelled by its own cancel() or whenever this one is
+  CancelToken child() const;
+
+  /// the token of the evaluation running on this thread, or an empty
+  /// token if there is none
+  static CancelToken current() noexcept;
+
+  /// false for the empty token returned by current()
+  explicit operator bool() const noexcept;
+
+private:
+
+  struct State {
+    explicit State(const std::shared_ptr<State> & up): cancelled(false), parent(up) {}
+    std::atomic<bool> cancelled;
+    std::shared_ptr<State> parent;
+  };
+
+  explicit CancelToken(const std::shared_ptr<State> & state);
+
+  std::shared_ptr<State> m_state;
+};
+
+/*! \class CancelScope
+\brief Runs the rest of a block on the calling thread under a token.
+
+Scopes nest, the previous token is restored when the scope ends.
+ */
+class CancelScope {
+public:
+
+  /// make token the token of the calling thread
+  explicit CancelScope(const CancelToken & token) noexcept;
+
+  /// restore the token the thread had before
+  ~CancelScope();
+
+  CancelScope(const CancelScope &) = delete;
+  CancelScope & operator=(const CancelScope &) = delete;
+
+private:
+  CancelToken m_token;
+  const CancelToken * m_previous;
+};
+
+/*! \class CancelPoll
+\brief An amortized cancellation check for long native loops.
+
+Calling tick() once per iteration looks at the token of the running
+evaluation, and at its time and memory limits, only every interval
+iterations. A loop over millions of elements then stops within a few
+milliseconds of being cancelled at almost no cost per element.
+ */
+class CancelPoll {
+public:
+
+  /// iterations between checks
+  static const unsigned interval = 4096;
+
+  CancelPoll(): m_count(0) {}
+
+  /// count one iteration
+  /// \throws SemanticError when cancelled, LimitError when over a limit
+  void tick() {
+    if (++m_count == interval) {
+      m_count = 0;
+      check();
+    }
+  }
+
+  /// check at once
+  static void check();
+
+private:
+  unsigned m_count;
+};
+
+// the token of the innermost scope on the calling thread, null outside any
+extern thread_local const CancelToken * current_cancel_token;
+
+/// true once the evaluation running on this thread was cancelled. Cheap
+/// enough to call at every evaluation step.
+inline bool cancellation_requested() noexcept {
+  const CancelToken * token = current_cancel_token;
+  return token && token->cancelled();
+}
+
+#endif
@@ -0,0 +1,148 @@
+#include "catch.hpp"
+
+#include "cancel.hpp"
+#include "environment.hpp"
+#include "sequence.hpp"
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+TEST_CASE("Test copies of a token share its state", "[cancel]") {
+	CancelToken token;
+	CancelToken copy = token;
+	REQUIRE(token);
+	REQUIRE(!copy.cancelled());
+	copy.cancel();
+	REQUIRE(token.cancelled());
+	REQUIRE(copy.cancelled());
+}
+
+TEST_CASE("Test scopes set and restore the current token", "[cancel]") {
+	REQUIRE(!CancelToken::current());
+	REQUIRE(!cancellation_requested());
+
+	CancelToken outer;
+	CancelToken inner;
+	{
+		CancelScope scope(outer);
+		REQUIRE(CancelToken::current());
+		{
+			CancelScope nested(inner);
+			inner.cancel();
+			REQUIRE(cancellation_requested());
+		}
+		REQUIRE(!cancellation_requested());
+		outer.cancel();
+		REQUIRE(cancellation_requested());
+	}
+	REQUIRE(!CancelToken::current());
+	REQUIRE(!cancellation_requested());
+}
+
+TEST_CASE("Test pool tasks run under the token of their submitter", "[cancel]") {
+	ThreadPool pool(2);
+	CancelToken token;
+	token.cancel();
+
+	std::atomic<int> seen(0);
+	{
+		CancelScope scope(token);
+		TaskGroup group(pool);
+		for (int i = 0; i < 8; i++) {
+			group.run([&seen]() {
+				if (cancellation_requested()) ++seen;
+			});
+		}
+		group.wait();
+	}
+	REQUIRE(seen == 8);
+
+	// tasks submitted outside any scope are not cancelled
+	seen = 0;
+	TaskGroup group(pool);
+	group.run([&seen]() {
+		if (cancellation_requested()) ++seen;
+	});
+	group.wait();
+	REQUIRE(seen == 0);
+}
+
+TEST_CASE("Test a cancelled request does not start", "[cancel]") {
+	Interpreter interp;
+	std::istringstream program("(+ 1 2)");
+	REQUIRE(interp.parseStream(program));
+
+	CancelToken token;
+	token.cancel();
+	REQUIRE_THROWS_AS(interp.evaluate(token), SemanticError);
+
+	// other requests to the same interpreter are unaffected
+	REQUIRE(interp.evaluate(CancelToken()) == Expression(3.));
+	REQUIRE(interp.evaluate() == Expression(3.));
+}
+
+TEST_CASE("Test cancelling one running request", "[cancel]") {
+	Interpreter busy;
+	std::istringstream program("(begin (define f (lambda (acc x) (+ acc x))) (fold-range f 0 0 1e9 1))");
+	REQUIRE(busy.parseStream(program));
+
+	CancelToken token;
+	std::thread canceller([token]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		token.cancel();
+	});
+	REQUIRE_THROWS_AS(busy.evaluate(token), SemanticError);
+	canceller.join();
+
+	Interpreter other;
+	std::istringstream sum("(+ 1 2)");
+	REQUIRE(other.parseStream(sum));
+	REQUIRE(other.evaluate(CancelToken()) == Expression(3.));
+}
+
+TEST_CASE("Test a child token is cancelled with its parent", "[cancel]") {
+	CancelToken parent;
+	CancelToken child = parent.child();
+	child.cancel();
+	REQUIRE(child.cancelled());
+	REQUIRE(!parent.cancelled());
+
+	CancelToken other = parent.child();
+	parent.cancel();
+	REQUIRE(other.cancelled());
+
+	// the child of the empty token is only cancelled by itself
+	CancelToken root = CancelToken::current().child();
+	REQUIRE(root);
+	REQUIRE(!root.cancelled());
+}
+
+TEST_CASE("Test native loops poll for cancellation", "[cancel]") {
+	Environment env;
+	std::vector<Expression> elements(3 * CancelPoll::interval, Expression(1.));
+	std::vector<Expression> args = { Expression(elements) };
+	args[0].head().setList();
+
+	CancelToken token;
+	token.cancel();
+	CancelScope scope(token);
+	REQUIRE_THROWS_AS(env.get_proc(Atom("reverse"))(args), SemanticError);
+	args.push_back(args[0]);
+	REQUIRE_THROWS_AS(env.get_proc(Atom("join"))(args), SemanticError);
+	REQUIRE_THROWS_AS(env.get_proc(Atom("zip"))(args), SemanticError);
+
+	// a short loop never reaches a check
+	std::vector<Expression> small = { Expression(std::vector<Expression>(10, Expression(1.))) };
+	REQUIRE_NOTHROW(env.get_proc(Atom("reverse"))(small));
+
+	// materializing a cancelled lazy list gives up and leaves it lazy
+	Expression lazy = Expression::fromSequence(RangeSequence::make(0, 1e5, 1));
+	REQUIRE_THROWS_AS(lazy.tailConstBegin(), SemanticError);
+	REQUIRE(lazy.isLazy());
+	REQUIRE(lazy.tailSize() == 100001);
+}
@@ -1,10 +1,15 @@
 #include "environment.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <limits>
+#include <new>
 
 #include "environment.hpp"
 #include "semantic_error.hpp"
+#include "budget.hpp"
+#include "cancel.hpp"
 
 /*********************************************************************** 
 Helper Functions
@@ -15,6 +20,45 @@ bool nargs_equal(const std::vector<Expression> & args, unsigned nargs){
   return args.size() == nargs;
 }
 
+// the argument is a non-negative whole number that fits a size_t, stored
+// in index
+bool index_arg(const Expression & arg, std::size_t & index) {
+	if (!arg.isHeadNumber()) {
+		return false;
+	}
+	double value = arg.head().asNumber();
+	if (!std::isfinite(value) || value < 0 || value != std::floor(value) ||
+		value >= static_cast<double>(std::numeric_limits<std::size_t>::max())) {
+		return false;
+	}
+	index = static_cast<std::size_t>(value);
+	return true;
+}
+
+// make room for size elements of a new list, failing first if they would
+// exceed the memory limit of the running evaluation
+static void reserve_list(std::vector<Expression> & result, std::size_t size) {
+	if (current_budget) {
+		current_budget->require(size * sizeof(Expression));
+	}
+	result.reserve(size);
+}
+
+// the elements [begin, end) of a list, a view when the list is lazy
+Expression sublist(const Expression & list, std::size_t begin, std::size_t end) {
+	if (list.isLazy()) {
+		return Expression::fromSequence(list.sequence()->slice(begin, end));
+	}
+	std::vector<Expression> result;
+	reserve_list(result, end - begin);
+	CancelPoll poll;
+	for (std::size_t i = begin; i < end; i++) {
+		poll.tick();
+		result.push_back(list.tailAt(i));
+	}
+	return Expression(result);
+}
+
 /*********************************************************************** 
 Each of the functions below have the signature that corresponds to the
 typedef'd Procedure function pointer.
@@ -450,8 +494,8 @@ Expression first(const std::vector<Expression> & args) {
 			throw SemanticError("Error: argument to first is not a list.");
 		}
 		else {
-			if (args[0].tailConstBegin() != args[0].tailConstEnd()) {
-				return Expression(*args[0].tailConstBegin());
+			if (args[0].tailSize() != 0) {
+				return args[0].tailAt(0);
 			}
 			else {
 				throw SemanticError("Error: argument to first is an empty list");
@@ -464,20 +508,14 @@ Expression first(const std::vector<Expression> & args) {
 }
 
 Expression rest(const std::vector<Expression> & args) {
-	std::vector<Expression> result;
 	if (nargs_equal(args, 1)) {
 		if (!args[0].isHeadList()) {
 			throw SemanticError("Error: argument to rest is not a list.");
 		}
 		else {
-			if (args[0].tailConstBegin() != args[0].tailConstEnd()) {
-				auto e = args[0].tailConstBegin();
-				e++;
-				while (e != args[0].tailConstEnd()) {
-					result.push_back(Expression(*e));
-					e++;
-				}
-				return Expression(result);
+			if (args[0].tailSize() != 0) {
+				// the rest of a lazy list is a view, nothing is produced
+				return sublist(args[0], 1, args[0].tailSize());
 			}
 			else {
 				throw SemanticError("Error: argument to rest is an empty list");
@@ -492,12 +530,7 @@ Expression rest(const std::vector<Expression> & args) {
 Expression length(const std::vector<Expression> & args) {
 	if (nargs_equal(args, 1)) {
 		if (args[0].isHeadList()) {
-			int counter = 0;
-			for (auto e = args[0].tailConstBegin(); e != args[0].tailConstEnd(); e++)
-			{
-				counter++;
-			}
-			return Expression(counter);
+			return Expression(static_cast<double>(args[0].tailSize()));
 		}
 		else {
 			throw SemanticError("Error: argument to length is not a list.");
@@ -513,7 +546,9 @@ Expression append(const std::vector<Expression> & args) {
 	if (nargs_equal(args, 2)) {
 		if (args[0].isHeadList()) {
 			if (!args[1].isHeadList()) {
+				CancelPoll poll;
 				for (auto e = args[0].tailConstBegin(); e != args[0].tailConstEnd(); e++) {
+					poll.tick();
 					result.push_back(Expression(*e));
 				}
 				result.push_back(args[1]);
@@ -537,10 +572,13 @@ Expression join(const std::vector<Expression> & args) {
 	if (nargs_equal(args, 2)) {
 		if (args[0].isHeadList()) {
 			if (args[1].isHeadList()) {
+				CancelPoll poll;
 				for (auto e = args[0].tailConstBegin(); e != args[0].tailConstEnd(); e++) {
+					poll.tick();
 					result.push_back(Expression(*e));
 				}
 				for (auto f = args[1].tailConstBegin(); f != args[1].tailConstEnd(); f++) {
+					poll.tick();
 					result.push_back(Expression(*f));
 				}
 				return Expression(result);
@@ -558,8 +596,9 @@ Expression join(const std::vector<Expression> & args) {
 	}
 }
 
+// range is lazy, its elements are only produced when the list is printed,
+// drawn or otherwise iterated as a whole
 Expression range(const std::vector<Expression> & args) {
-	std::vector<Expression> result;
 	if (nargs_equal(args, 3)) {
 		if (args[0].isHeadNumber() && args[1].isHeadNumber() && args[2].isHeadNumber()) {
 			double e = args[0].head().asNumber();
@@ -567,11 +606,7 @@ Expression range(const std::vector<Expression> & args) {
 			double g = args[2].head().asNumber();
 			if( g > 0 ) {
 				if (e < f) {
-					while (e <= f) {
-						result.push_back(Expression(e));
-						e += g;
-					}
-					return Expression(result);
+					return Expression::fromSequence(RangeSequence::make(e, f, g));
 				}
 				else {
 					throw SemanticError("Error: begin greater than end in range.");
@@ -590,59 +625,272 @@ Expression range(const std::vector<Expression> & args) {
 	}
 }
 
+/*
+Sequence procedures
+Functions included below: nth, last, slice, take, drop, reverse, zip
+These index the tail directly, and slice, take and drop of a lazy list are
+views of the same sequence.
+*/
+
+Expression nth(const std::vector<Expression> & args) {
+	std::size_t index;
+	if (nargs_equal(args, 2)) {
+		if (!args[0].isHeadList()) {
+			throw SemanticError("Error: first argument to nth is not a list.");
+		}
+		else if (!index_arg(args[1], index)) {
+			throw SemanticError("Error: second argument to nth is not a valid index.");
+		}
+		else if (index >= args[0].tailSize()) {
+			throw SemanticError("Error: index to nth is out of range.");
+		}
+		return args[0].tailAt(index);
+	}
+	else {
+		throw SemanticError("Error in call to nth: Invalid number of arguments.");
+	}
+}
+
+Expression last(const std::vector<Expression> & args) {
+	if (nargs_equal(args, 1)) {
+		if (!args[0].isHeadList()) {
+			throw SemanticError("Error: argument to last is not a list.");
+		}
+		else if (args[0].tailSize() == 0) {
+			throw SemanticError("Error: argument to last is an empty list");
+		}
+		return args[0].tailAt(args[0].tailSize() - 1);
+	}
+	else {
+		throw SemanticError("Error in call to last: Invalid number of arguments.");
+	}
+}
+
+// the elements from begin up to but not including end, an end past the
+// last element is clamped
+Expression slice(const std::vector<Expression> & args) {
+	std::size_t begin;
+	std::size_t end;
+	if (nargs_equal(args, 3)) {
+		if (!args[0].isHeadList()) {
+			throw SemanticError("Error: first argument to slice is not a list.");
+		}
+		else if (!index_arg(args[1], begin) || !index_arg(args[2], end)) {
+			throw SemanticError("Error: bounds of slice are not valid indices.");
+		}
+		end = std::min(end, args[0].tailSize());
+		if (begin > end) {
+			throw SemanticError("Error: begin greater than end in slice.");
+		}
+		return sublist(args[0], begin, end);
+	}
+	else {
+		throw SemanticError("Error in call to slice: Invalid number of arguments.");
+	}
+}
+
+Expression take(const std::vector<Expression> & args) {
+	std::size_t count;
+	if (nargs_equal(args, 2)) {
+		if (!args[0].isHeadList()) {
+			throw SemanticError("Error: first argument to take is not a list.");
+		}
+		else if (!index_arg(args[1], count)) {
+			throw SemanticError("Error: second argument to take is not a valid count.");
+		}
+		return sublist(args[0], 0, std::min(count, args[0].tailSize()));
+	}
+	else {
+		throw SemanticError("Error in call to take: Invalid number of arguments.");
+	}
+}
+
+Expression drop(const std::vector<Expression> & args) {
+	std::size_t count;
+	if (nargs_equal(args, 2)) {
+		if (!args[0].isHeadList()) {
+			throw SemanticError("Error: first argument to drop is not a list.");
+		}
+		else if (!index_arg(args[1], count)) {
+			throw SemanticError("Error: second argument to drop is not a valid count.");
+		}
+		std::size_t size = args[0].tailSize();
+		return sublist(args[0], std::min(count, size), size);
+	}
+	else {
+		throw SemanticError("Error in call to drop: Invalid number of arguments.");
+	}
+}
+
+Expression reverse(const std::vector<Expression> & args) {
+	std::vector<Expression> result;
+	if (nargs_equal(args, 1)) {
+		if (!args[0].isHeadList()) {
+			throw SemanticError("Error: argument to reverse is not a list.");
+		}
+		std::size_t size = args[0].tailSize();
+		reserve_list(result, size);
+		CancelPoll poll;
+		for (std::size_t i = size; i > 0; i--) {
+			poll.tick();
+			result.push_back(args[0].tailAt(i - 1));
+		}
+		return Expression(result);
+	}
+	else {
+		throw SemanticError("Error in call to reverse: Invalid number of arguments.");
+	}
+}
+
+// pairs up the elements of two lists, stopping at the end of the shorter
+Expression zip(const std::vector<Expression> & args) {
+	std::vector<Expression> result;
+	if (nargs_equal(args, 2)) {
+		if (!args[0].isHeadList() || !args[1].isHeadList()) {
+			throw SemanticError("Error: argument to zip is not a list.");
+		}
+		std::size_t size = std::min(args[0].tailSize(), args[1].tailSize());
+		reserve_list(result, size);
+		std::vector<Expression> pair(2);
+		CancelPoll poll;
+		for (std::size_t i = 0; i < size; i++) {
+			poll.tick();
+			pair[0] = args[0].tailAt(i);
+			pair[1] = args[1].tailAt(i);
+			result.push_back(Expression(pair));
+		}
+		return Expression(result);
+	}
+	else {
+		throw SemanticError("Error in call to zip: Invalid number of arguments.");
+	}
+}
+
 const double PI = std::atan2(0, -1);
 const double EXP = std::exp(1);
 const std::complex<double> I (0.0,1.0);
 const std::complex<double> negI (0.0, -1.0);
 
-Environment::Environment(){
-
-  reset();
-}
+Environment::Environment(): m_runtime(std::make_shared<Runtime>()) {}
 
+// copies share the definitions until one of them changes
 Environment::Environment(const Environment & a) {
 	envmap = a.envmap;
+	m_runtime = a.m_runtime;
 }
 
 Environment & Environment::operator=(const Environment & a) {
 	if (this != &a) {
 		envmap = a.envmap;
+		m_runtime = a.m_runtime;
+	}
+	return *this;
+}
+
+Runtime & Environment::runtime() const {
+	return *m_runtime;
+}
+
+Environment Environment::isolated() const {
+	Environment copy(*this);
+	copy.m_runtime = std::make_shared<Runtime>();
+	copy.m_runtime->copySettings(*m_runtime);
+	return copy;
+}
+
+const Environment::EnvResult * Environment::find(const Atom & sym) const {
+	if (!sym.isSymbol()) return nullptr;
+
+	// hash once for both tables
+	const std::string & name = sym.asSymbol();
+	std::uint64_t h = SymbolTable<EnvResult>::hash(name);
+	const EnvResult * defined = envmap ? envmap->find(name, h) : nullptr;
+	return defined ? defined : builtins().find(name, h);
+}
+
+SymbolTable<Environment::EnvResult> & Environment::definitions() {
+	if (!envmap) {
+		envmap = std::make_shared<SymbolTable<EnvResult>>();
+	}
+	else if (envmap.use_count() > 1) {
+		envmap = std::make_shared<SymbolTable<EnvResult>>(*envmap);
+	}
+	return *envmap;
+}
+
+Environment::EnvResult::EnvResult(EnvResultType t, const Expression & e): type(t) {
+	new (&exp) Expression(e);
+}
+
+Environment::EnvResult::EnvResult(EnvResultType t, Procedure p): type(t), proc(p) {}
+
+Environment::EnvResult::EnvResult(const EnvResult & a): type(a.type) {
+	if (type == ExpressionType) {
+		new (&exp) Expression(a.exp);
+	}
+	else {
+		proc = a.proc;
+	}
+}
+
+Environment::EnvResult::EnvResult(EnvResult && a) noexcept: type(a.type) {
+	if (type == ExpressionType) {
+		new (&exp) Expression(std::move(a.exp));
+	}
+	else {
+		proc = a.proc;
+	}
+}
+
+Environment::EnvResult & Environment::EnvResult::operator=(const EnvResult & a) {
+	if (this != &a) {
+		// copy first, so a failed copy leaves this as it was
+		EnvResult copy(a);
+		*this = std::move(copy);
+	}
+	return *this;
+}
+
+Environment::EnvResult & Environment::EnvResult::operator=(EnvResult && a) noexcept {
+	if (this != &a) {
+		this->~EnvResult();
+		new (this) EnvResult(std::move(a));
 	}
 	return *this;
 }
 
+Environment::EnvResult::~EnvResult() {
+	if (type == ExpressionType) {
+		exp.~Expression();
+	}
+}
+
 // Shadow function created to edit the temp environment passed in,
 // chacks for redefinition of symbols
 void Environment::shadow(const std::string & args, Environment & newenv) {
-	if (newenv.envmap.find(args) != newenv.envmap.end() ) {
-		newenv.envmap.erase(args);
+	if (newenv.envmap && newenv.envmap->find(args)) {
+		newenv.definitions().erase(args);
 	}
 }
 
 // helper function to return if it is in fact known
 // "it is known" - Khaleesi, breaker of chains, mother of dragons, queen of the andals and the first men
 bool Environment::is_known(const Atom & sym) const{
-  if(!sym.isSymbol()) return false;
-  
-  return envmap.find(sym.asSymbol()) != envmap.end();
+  return find(sym) != nullptr;
 }
 
 bool Environment::is_exp(const Atom & sym) const{
-  if(!sym.isSymbol()) return false;
-  
-  auto result = envmap.find(sym.asSymbol());
-  return (result != envmap.end()) && (result->second.type == ExpressionType);
+  const EnvResult * result = find(sym);
+  return result && (result->type == ExpressionType);
 }
 
 Expression Environment::get_exp(const Atom & sym) const{
 
   Expression exp;
   
-  if(sym.isSymbol()){
-    auto result = envmap.find(sym.asSymbol());
-    if((result != envmap.end()) && (result->second.type == ExpressionType)){
-      exp = result->second.exp;
-    }
+  const EnvResult * result = find(sym);
+  if(result && (result->type == ExpressionType)){
+    exp = result->exp;
   }
 
   return exp;
@@ -652,118 +900,179 @@ void Environment::add_exp(const Atom & sym, const Expression & exp){
 	if(!sym.isSymbol()){
 		throw SemanticError("Attempt to add non-symbol to environment (add_exp error)");
 	}
-	// error if overwriting symbol map
-	if(envmap.find(sym.asSymbol()) != envmap.end()){
-		envmap.erase(sym.asSymbol());
-		//throw SemanticError("Attempt to overwrite symbol in environment (add_exp error)");
-	}
-	envmap.emplace(sym.asSymbol(), EnvResult(ExpressionType, exp)); 
+	// replaces any earlier definition
+	definitions().assign(sym.asSymbol(), EnvResult(ExpressionType, exp));
+}
+
+std::map<std::string, Expression> Environment::expressions() const{
+  std::map<std::string, Expression> result;
+  // definitions first, emplace keeps them over the builtins they hide
+  auto add = [&result](const std::string & name, const EnvResult & value){
+    if(value.type == ExpressionType){
+      result.emplace(name, value.exp);
+    }
+  };
+  if(envmap){
+    envmap->forEach(add);
+  }
+  builtins().forEach(add);
+  return result;
 }
 
 bool Environment::is_proc(const Atom & sym) const{
-  if(!sym.isSymbol()) return false;
-  
-  auto result = envmap.find(sym.asSymbol());
-  return (result != envmap.end()) && (result->second.type == ProcedureType);
+  const EnvResult * result = find(sym);
+  return result && (result->type == ProcedureType);
 }
 
 Procedure Environment::get_proc(const Atom & sym) const{
 
-  //Procedure proc = default_proc;
-
-  if(sym.isSymbol()){
-    auto result = envmap.find(sym.asSymbol());
-    if((result != envmap.end()) && (result->second.type == ProcedureType)){
-      return result->second.proc;
-    }
+  const EnvResult * result = find(sym);
+  if(result && (result->type == ProcedureType)){
+    return result->proc;
   }
 
   return default_proc;
 }
 
+bool Environment::is_builtin_exp(const Atom & sym) const{
+  if(!sym.isSymbol()) return false;
+
+  const EnvResult * builtin = builtins().find(sym.asSymbol());
+  return builtin && (builtin->type == ExpressionType) && (find(sym) == builtin);
+}
+
+bool Environment::is_builtin_proc(const Atom & sym){
+  if(!sym.isSymbol()) return false;
+
+  const EnvResult * result = builtins().find(sym.asSymbol());
+  return result && (result->type == ProcedureType);
+}
+
 /*
-Reset the environment to the default state. First remove all entries and
-then re-add the default ones.
+Reset the environment to the default state, forgetting every definition
+made on top of the builtins.
  */
 void Environment::reset(){
 
-  envmap.clear();
-  
-  // Built-In value of pi
-  envmap.emplace("pi", EnvResult(ExpressionType, Expression(PI)));
+  // copies made before keep their definitions
+  envmap.reset();
+
+  // results of lambdas reading the old globals are stale
+  m_runtime->memo().clear();
+}
+
+/*
+Make the builtin frame. It is built once, the first time any environment
+looks up a symbol, and never modified afterwards, so every thread can read
+it without locking.
+ */
+const SymbolTable<Environment::EnvResult> & Environment::builtins(){
+
+  static const SymbolTable<EnvResult> frame = []{
+
+    SymbolTable<EnvResult> envmap;
+
+    // Built-In value of pi
+    envmap.assign("pi", EnvResult(ExpressionType, Expression(PI)));
+
+    // Procedure: add;
+    envmap.assign("+", EnvResult(ProcedureType, add)); 
+
+    // Procedure: subneg;
+    envmap.assign("-", EnvResult(ProcedureType, subneg)); 
+
+    // Procedure: mul;
+    envmap.assign("*", EnvResult(ProcedureType, mul)); 
+
+    // Procedure: div;
+    envmap.assign("/", EnvResult(ProcedureType, div)); 
+
+    // Built-In value of Euler's number
+    envmap.assign("e", EnvResult(ExpressionType, Expression(EXP)));
+
+    // Procedure: sqrt;
+    envmap.assign("sqrt", EnvResult(ProcedureType, sqrt));
+
+    // Procedure: pow;
+    envmap.assign("^", EnvResult(ProcedureType, pow));
+
+    // Procedure: ln;
+    envmap.assign("ln", EnvResult(ProcedureType, ln));
+
+    // Procedure: sin;
+    envmap.assign("sin", EnvResult(ProcedureType, sin));
 
-  // Procedure: add;
-  envmap.emplace("+", EnvResult(ProcedureType, add)); 
+    // Procedure: cos;
+    envmap.assign("cos", EnvResult(ProcedureType, cos));
 
-  // Procedure: subneg;
-  envmap.emplace("-", EnvResult(ProcedureType, subneg)); 
+    // Procedure: tan;
+    envmap.assign("tan", EnvResult(ProcedureType, tan));
 
-  // Procedure: mul;
-  envmap.emplace("*", EnvResult(ProcedureType, mul)); 
+    // Built-In value of Imaginary I
+    envmap.assign("I", EnvResult(ExpressionType, Expression(I)));
 
-  // Procedure: div;
-  envmap.emplace("/", EnvResult(ProcedureType, div)); 
+    // Built-In value of negative Imaginary -I
+    envmap.assign("-I", EnvResult(ExpressionType, Expression(negI)));
 
-  // Built-In value of Euler's number
-  envmap.emplace("e", EnvResult(ExpressionType, Expression(EXP)));
+    // Procedure: real;
+    envmap.assign("real", EnvResult(ProcedureType, real));
 
-  // Procedure: sqrt;
-  envmap.emplace("sqrt", EnvResult(ProcedureType, sqrt));
+    // Procedure: imag;
+    envmap.assign("imag", EnvResult(ProcedureType, imag));
 
-  // Procedure: pow;
-  envmap.emplace("^", EnvResult(ProcedureType, pow));
+    // Procedure: mag;
+    envmap.assign("mag", EnvResult(ProcedureType, abs));
 
-  // Procedure: ln;
-  envmap.emplace("ln", EnvResult(ProcedureType, ln));
+    // Procedure: arg;
+    envmap.assign("arg", EnvResult(ProcedureType, arg));
 
-  // Procedure: sin;
-  envmap.emplace("sin", EnvResult(ProcedureType, sin));
+    // Procedure: conj;
+    envmap.assign("conj", EnvResult(ProcedureType, conj));
 
-  // Procedure: cos;
-  envmap.emplace("cos", EnvResult(ProcedureType, cos));
+    // Procedure: List;
+    envmap.assign("list", EnvResult(ProcedureType, list));
 
-  // Procedure: tan;
-  envmap.emplace("tan", EnvResult(ProcedureType, tan));
+    // Procedure: first;
+    envmap.assign("first", EnvResult(ProcedureType, first));
 
-  // Built-In value of Imaginary I
-  envmap.emplace("I", EnvResult(ExpressionType, Expression(I)));
+    // Procedure: rest;
+    envmap.assign("rest", EnvResult(ProcedureType, rest));
 
-  // Built-In value of negative Imaginary -I
-  envmap.emplace("-I", EnvResult(ExpressionType, Expression(negI)));
+    // Procedure: length;
+    envmap.assign("length", EnvResult(ProcedureType, length));
 
-  // Procedure: real;
-  envmap.emplace("real", EnvResult(ProcedureType, real));
+    // Procedure: append;
+    envmap.assign("append", EnvResult(ProcedureType, append));
 
-  // Procedure: imag;
-  envmap.emplace("imag", EnvResult(ProcedureType, imag));
+    // Procedure: join;
+    envmap.assign("join", EnvResult(ProcedureType, join));
 
-  // Procedure: mag;
-  envmap.emplace("mag", EnvResult(ProcedureType, abs));
+    // Procedure: range;
+    envmap.assign("range", EnvResult(ProcedureType, range));
 
-  // Procedure: arg;
-  envmap.emplace("arg", EnvResult(ProcedureType, arg));
+    // Procedure: nth;
+    envmap.assign("nth", EnvResult(ProcedureType, nth));
 
-  // Procedure: conj;
-  envmap.emplace("conj", EnvResult(ProcedureType, conj));
+    // Procedure: last;
+    envmap.assign("last", EnvResult(ProcedureType, last));
 
-  // Procedure: List;
-  envmap.emplace("list", EnvResult(ProcedureType, list));
+    // Procedure: slice;
+    envmap.assign("slice", EnvResult(ProcedureType, slice));
 
-  // Procedure: first;
-  envmap.emplace("first", EnvResult(ProcedureType, first));
+    // Procedure: take;
+    envmap.assign("take", EnvResult(ProcedureType, take));
 
-  // Procedure: rest;
-  envmap.emplace("rest", EnvResult(ProcedureType, rest));
+    // Procedure: drop;
+    envmap.assign("drop", EnvResult(ProcedureType, drop));
 
-  // Procedure: length;
-  envmap.emplace("length", EnvResult(ProcedureType, length));
+    // Procedure: reverse;
+    envmap.assign("reverse", EnvResult(ProcedureType, reverse));
 
-  // Procedure: append;
-  envmap.emplace("append", EnvResult(ProcedureType, append));
+    // Procedure: zip;
+    envmap.assign("zip", EnvResult(ProcedureType, zip));
 
-  // Procedure: join;
-  envmap.emplace("join", EnvResult(ProcedureType, join));
+    return envmap;
+  }();
 
-  // Procedure: range;
-  envmap.emplace("range", EnvResult(ProcedureType, range));
+  return frame;
 }
@@ -12,10 +12,13 @@ needed.
 
 // system includes
 #include <map>
+#include <memory>
 
 // module includes
 #include "atom.hpp"
 #include "expression.hpp"
+#include "runtime.hpp"
+#include "symbol_table.hpp"
 
 /*! \typedef Procedure
 \brief A Procedure is a C++ function pointer taking a vector of 
@@ -36,6 +39,15 @@ return you can obtain
 the mapped-to value using get_exp or get_proc.
 
 To add an symbol to expression mapping use the add_exp member function.
+
+The builtin procedures and constants live in one immutable frame shared by
+every environment, which only holds the definitions made on top of it.
+Copies share those definitions until one of them defines or resets, which
+copies the table first, so copying an environment takes constant time and
+a copy is a snapshot that later definitions do not change.
+
+A default constructed environment starts a new Runtime; copies share the
+Runtime of the environment they were copied from, isolated() copies do not.
  */
 class Environment {
 public:
@@ -74,6 +86,11 @@ public:
    */
   void add_exp(const Atom &sym, const Expression &exp);
 
+  /*! The symbols defined as expressions, the builtin constants included.
+    \return each symbol with the expression it maps to, in symbol order
+   */
+  std::map<std::string, Expression> expressions() const;
+
   /*! Determine if a symbol has been defined as a procedure
     \param sym the symbol to lookup
     \return true if thr symbol maps to a procedure
@@ -89,27 +106,71 @@ public:
   */
   Procedure get_proc(const Atom &sym) const;
 
+  /*! Determine if a symbol is a builtin procedure, whatever any
+    environment defines it as.
+    \param sym the symbol to lookup
+    \return true if the symbol names a builtin procedure
+   */
+  static bool is_builtin_proc(const Atom &sym);
+
+  /*! Determine if a symbol maps to a builtin constant, such as pi, that no
+    definition in this environment hides.
+    \param sym the symbol to lookup
+    \return true if the symbol maps to the builtin value
+   */
+  bool is_builtin_exp(const Atom &sym) const;
+
   /*! Reset the environment to its default state. */
   void reset();
 
+  /// the runtime shared with every copy of this environment
+  Runtime & runtime() const;
+
+  /*! A copy with the same definitions and a Runtime of its own, with the
+    same settings but empty caches, so nothing evaluated in one is seen by
+    the other or cleared by it.
+   */
+  Environment isolated() const;
+
 private:
   
   // Environment is a mapping from symbols to expressions or procedures
   enum EnvResultType { ExpressionType, ProcedureType };
 
+  // what a symbol maps to, an expression or a procedure but never both
   struct EnvResult {
     EnvResultType type;
-    Expression exp; // used when type is ExpressionType
-    Procedure proc; // used when type is ProcedureType
-
-    // constructors for use in container emplace
-    EnvResult(){};
-    EnvResult(EnvResultType t, Expression e) : type(t), exp(e){};
-    EnvResult(EnvResultType t, Procedure p) : type(t), proc(p){};
+    union {
+      Expression exp; // used when type is ExpressionType
+      Procedure proc; // used when type is ProcedureType
+    };
+
+    // constructors for use in the symbol table
+    EnvResult(EnvResultType t, const Expression & e);
+    EnvResult(EnvResultType t, Procedure p);
+    EnvResult(const EnvResult & a);
+    EnvResult(EnvResult && a) noexcept;
+    EnvResult & operator=(const EnvResult & a);
+    EnvResult & operator=(EnvResult && a) noexcept;
+    ~EnvResult();
   };
 
-  // the environment map
-  std::map<std::string, EnvResult> envmap;
+  // the frame of builtins shared by every environment, made on first use
+  static const SymbolTable<EnvResult> & builtins();
+
+  // the entry for symbol, defined here or builtin, or nullptr
+  const EnvResult * find(const Atom & sym) const;
+
+  // the definitions, copied first if another environment shares them
+  SymbolTable<EnvResult> & definitions();
+
+  // the definitions made on top of the builtins, hiding any of the same
+  // name. Shared between copies and never modified while shared, null
+  // until the first definition.
+  std::shared_ptr<SymbolTable<EnvResult>> envmap;
+
+  // the caches and settings of the interpreter owning this environment
+  std::shared_ptr<Runtime> m_runtime;
 };
 
 #endif
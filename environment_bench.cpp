@@ -0,0 +1,97 @@
+/*
+Lookup and define benchmark for the environment symbol table.
+
+Each case runs on SymbolTable, which environments use, and on a std::map
+with the find, erase and emplace that Environment used to do, for
+comparison. Lookups search the names a program defines, then names that
+miss its definitions as builtin names do, and defining replaces existing
+names as define and lambda parameters do. Environment itself is timed for
+a define and a builtin lookup.
+
+usage: environment_bench [N]
+*/
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "environment.hpp"
+#include "symbol_table.hpp"
+
+// the map based table, kept here as the baseline
+class MapTable {
+public:
+	const Expression * find(const std::string & name) const {
+		auto found = map.find(name);
+		return found == map.end() ? nullptr : &found->second;
+	}
+
+	void assign(const std::string & name, const Expression & exp) {
+		if (map.find(name) != map.end()) {
+			map.erase(name);
+		}
+		map.emplace(name, exp);
+	}
+
+private:
+	std::map<std::string, Expression> map;
+};
+
+// nanoseconds per call of f over n calls
+template<typename F>
+static double measure(std::size_t n, F f) {
+	auto start = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < n; i++) {
+		f(i);
+	}
+	auto stop = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::nano>(stop - start).count() / n;
+}
+
+// run every case on table, printing one line each
+template<typename Table>
+static void run(const std::string & label, std::size_t n, const std::vector<std::string> & names,
+	const std::vector<std::string> & misses) {
+	Table table;
+	for (auto & name : names) {
+		table.assign(name, Expression(1.));
+	}
+
+	std::size_t found = 0;
+	double hit = measure(n, [&](std::size_t i) { found += table.find(names[i % names.size()]) != nullptr; });
+	double miss = measure(n, [&](std::size_t i) { found += table.find(misses[i % misses.size()]) != nullptr; });
+	double define = measure(n, [&](std::size_t i) { table.assign(names[i % names.size()], Expression(2.)); });
+	if (found != n) {
+		std::cerr << label << ": lookups found " << found << " of " << n << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	std::cout << label << "  hit " << hit << " ns  miss " << miss << " ns  define " << define << " ns" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+	std::size_t n = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+	if (n == 0) n = 1;
+
+	for (std::size_t defined : { 8, 64, 1024 }) {
+		std::vector<std::string> names, misses;
+		for (std::size_t i = 0; i < defined; i++) {
+			names.push_back("user-symbol-" + std::to_string(i));
+		}
+		for (auto builtin : { "+", "-", "*", "/", "list", "first", "rest", "range", "sqrt", "append" }) {
+			misses.push_back(builtin);
+		}
+		std::cout << defined << " definitions" << std::endl;
+		run<SymbolTable<Expression>>("  SymbolTable", n, names, misses);
+		run<MapTable>("  std::map   ", n, names, misses);
+	}
+
+	Environment env;
+	Atom x("x"), plus("+");
+	std::size_t procs = 0;
+	double define = measure(n, [&](std::size_t i) { env.add_exp(x, Expression(double(i))); });
+	double builtin = measure(n, [&](std::size_t) { procs += env.is_proc(plus); });
+	std::cout << "Environment  define " << define << " ns  builtin lookup " << builtin << " ns" << std::endl;
+	return procs == n ? EXIT_SUCCESS : EXIT_FAILURE;
+}
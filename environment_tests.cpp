@@ -988,6 +988,12 @@ TEST_CASE("Test the list procedure: range", "[environment]") {
 	args8.emplace_back(Expression(1));
 	REQUIRE_THROWS_AS(prange(args8), SemanticError);
 
+	INFO("Testing range for throw argument: more elements than can be counted")
+	std::vector<Expression> args9 = { Expression(0), Expression(1e30), Expression(1) };
+	REQUIRE_THROWS_AS(prange(args9), SemanticError);
+	std::vector<Expression> args10 = { Expression(0), Expression(1 / 0.), Expression(1) };
+	REQUIRE_THROWS_AS(prange(args10), SemanticError);
+
 }
 
 TEST_CASE( "Test reset", "[environment]" ) {
@@ -1018,3 +1024,168 @@ TEST_CASE( "Test semeantic errors", "[environment]" ) {
   }
 }
 
+
+TEST_CASE("Test the sequence procedures: nth, take, drop", "[environment]") {
+	Environment env;
+	Procedure plist = env.get_proc(Atom("list"));
+	Procedure pnth = env.get_proc(Atom("nth"));
+	Procedure ptake = env.get_proc(Atom("take"));
+	Procedure pdrop = env.get_proc(Atom("drop"));
+	Procedure prange = env.get_proc(Atom("range"));
+
+	std::vector<Expression> elements = { Expression(1), Expression(2), Expression(3) };
+	Expression list = plist(elements);
+
+	INFO("Testing nth for proper outcome and bad indices")
+	std::vector<Expression> args = { list, Expression(2) };
+	REQUIRE(pnth(args) == Expression(3));
+	args = { list, Expression(3) };
+	REQUIRE_THROWS_AS(pnth(args), SemanticError);
+	args = { list, Expression(1.5) };
+	REQUIRE_THROWS_AS(pnth(args), SemanticError);
+	args = { list, Expression(-1) };
+	REQUIRE_THROWS_AS(pnth(args), SemanticError);
+	args = { Expression(1), Expression(0) };
+	REQUIRE_THROWS_AS(pnth(args), SemanticError);
+	args = { list, Expression(1e300) };
+	REQUIRE_THROWS_AS(pnth(args), SemanticError);
+	args = { list, Expression(1 / 0.) };
+	REQUIRE_THROWS_AS(pnth(args), SemanticError);
+
+	INFO("Testing take and drop, counts past the end are clamped")
+	std::vector<Expression> front = { Expression(1), Expression(2) };
+	std::vector<Expression> back = { Expression(3) };
+	args = { list, Expression(2) };
+	REQUIRE(ptake(args) == Expression(front));
+	REQUIRE(pdrop(args) == Expression(back));
+	args = { list, Expression(10) };
+	REQUIRE(ptake(args) == list);
+	REQUIRE(pdrop(args) == Expression(std::vector<Expression>()));
+	args = { list };
+	REQUIRE_THROWS_AS(ptake(args), SemanticError);
+	REQUIRE_THROWS_AS(pdrop(args), SemanticError);
+	args = { list, Expression(1e300) };
+	REQUIRE_THROWS_AS(ptake(args), SemanticError);
+	REQUIRE_THROWS_AS(pdrop(args), SemanticError);
+
+	INFO("Testing take and drop of a lazy list stay lazy")
+	std::vector<Expression> bounds = { Expression(0), Expression(1000000), Expression(1) };
+	args = { prange(bounds), Expression(10) };
+	REQUIRE(ptake(args).isLazy());
+	REQUIRE(pdrop(args).isLazy());
+	REQUIRE(pdrop(args).tailSize() == 999991);
+	args = { prange(bounds), Expression(999999) };
+	REQUIRE(pnth(args) == Expression(999999));
+}
+
+TEST_CASE("Test the sequence procedures: reverse, zip", "[environment]") {
+	Environment env;
+	Procedure plist = env.get_proc(Atom("list"));
+	Procedure preverse = env.get_proc(Atom("reverse"));
+	Procedure pzip = env.get_proc(Atom("zip"));
+
+	std::vector<Expression> elements = { Expression(1), Expression(2), Expression(3) };
+	std::vector<Expression> reversed = { Expression(3), Expression(2), Expression(1) };
+	std::vector<Expression> args = { plist(elements) };
+	REQUIRE(preverse(args) == Expression(reversed));
+	args = { Expression(1) };
+	REQUIRE_THROWS_AS(preverse(args), SemanticError);
+
+	std::vector<Expression> others = { Expression(4), Expression(5) };
+	std::vector<Expression> pair1 = { Expression(1), Expression(4) };
+	std::vector<Expression> pair2 = { Expression(2), Expression(5) };
+	std::vector<Expression> zipped = { Expression(pair1), Expression(pair2) };
+	args = { plist(elements), plist(others) };
+	REQUIRE(pzip(args) == Expression(zipped));
+	args = { plist(elements), Expression(1) };
+	REQUIRE_THROWS_AS(pzip(args), SemanticError);
+}
+
+TEST_CASE("Test the sequence procedures: last, slice", "[environment]") {
+	Environment env;
+	Procedure plist = env.get_proc(Atom("list"));
+	Procedure plast = env.get_proc(Atom("last"));
+	Procedure pslice = env.get_proc(Atom("slice"));
+	Procedure prange = env.get_proc(Atom("range"));
+
+	std::vector<Expression> elements = { Expression(1), Expression(2), Expression(3), Expression(4) };
+	Expression list = plist(elements);
+
+	INFO("Testing last")
+	std::vector<Expression> args = { list };
+	REQUIRE(plast(args) == Expression(4));
+	args = { plist(std::vector<Expression>()) };
+	REQUIRE_THROWS_AS(plast(args), SemanticError);
+
+	INFO("Testing slice, end is clamped")
+	std::vector<Expression> middle = { Expression(2), Expression(3) };
+	std::vector<Expression> tail = { Expression(3), Expression(4) };
+	args = { list, Expression(1), Expression(3) };
+	REQUIRE(pslice(args) == Expression(middle));
+	args = { list, Expression(2), Expression(100) };
+	REQUIRE(pslice(args) == Expression(tail));
+	args = { list, Expression(3), Expression(1) };
+	REQUIRE_THROWS_AS(pslice(args), SemanticError);
+	args = { list, Expression(0.5), Expression(1) };
+	REQUIRE_THROWS_AS(pslice(args), SemanticError);
+	args = { list, Expression(1) };
+	REQUIRE_THROWS_AS(pslice(args), SemanticError);
+
+	INFO("Testing last and slice of a lazy list")
+	std::vector<Expression> bounds = { Expression(0), Expression(10000000), Expression(1) };
+	args = { prange(bounds) };
+	REQUIRE(plast(args) == Expression(10000000));
+	args = { prange(bounds), Expression(5000000), Expression(5000002) };
+	REQUIRE(pslice(args).isLazy());
+	REQUIRE(pslice(args) == Expression(std::vector<Expression>{ Expression(5000000), Expression(5000001) }));
+}
+
+TEST_CASE( "Test definitions layered over the shared builtins", "[environment]" ) {
+
+  Environment env;
+  Environment other;
+
+  // a definition hides the builtin in its own environment only
+  env.add_exp(Atom("pi"), Expression(3.));
+  env.add_exp(Atom("+"), Expression(1.));
+  REQUIRE(env.get_exp(Atom("pi")) == Expression(3.));
+  REQUIRE(!env.is_proc(Atom("+")));
+  REQUIRE(env.is_exp(Atom("+")));
+  REQUIRE(other.get_exp(Atom("pi")) == Expression(std::atan2(0, -1)));
+  REQUIRE(other.is_proc(Atom("+")));
+  REQUIRE(Environment::is_builtin_proc(Atom("+")));
+  REQUIRE(!Environment::is_builtin_proc(Atom("pi")));
+
+  Environment copy = env;
+  REQUIRE(copy.get_exp(Atom("pi")) == Expression(3.));
+  REQUIRE(copy.expressions().at("pi") == Expression(3.));
+  REQUIRE(copy.expressions().count("e") == 1);
+
+  // reset uncovers the builtins again
+  env.reset();
+  REQUIRE(env.is_proc(Atom("+")));
+  REQUIRE(env.get_exp(Atom("pi")) == Expression(std::atan2(0, -1)));
+  REQUIRE(copy.get_exp(Atom("pi")) == Expression(3.));
+}
+
+TEST_CASE( "Test copies share definitions until one changes", "[environment]" ) {
+
+  Environment env;
+  env.add_exp(Atom("a"), Expression(1.));
+  Environment copy = env;
+  Environment other = env;
+
+  copy.add_exp(Atom("a"), Expression(2.));
+  copy.add_exp(Atom("b"), Expression(3.));
+  env.shadow("a", other);
+
+  REQUIRE(env.get_exp(Atom("a")) == Expression(1.));
+  REQUIRE(!env.is_known(Atom("b")));
+  REQUIRE(copy.get_exp(Atom("a")) == Expression(2.));
+  REQUIRE(copy.get_exp(Atom("b")) == Expression(3.));
+  REQUIRE(!other.is_known(Atom("a")));
+
+  env.reset();
+  REQUIRE(!env.is_known(Atom("a")));
+  REQUIRE(copy.get_exp(Atom("a")) == Expression(2.));
+}
@@ -5,40 +5,127 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cstring>
+#include <functional>
 
 #include "environment.hpp"
 #include "semantic_error.hpp"
+#include "thread_pool.hpp"
+#include "runtime.hpp"
+#include "future.hpp"
+#include "process_map.hpp"
+#include "cancel.hpp"
+#include "budget.hpp"
 
 volatile sig_atomic_t global_status_flag = 0;
 
-Expression::Expression(){}
+// count n tail elements made or freed against the memory limit of the
+// evaluation running on this thread
+static void charge_tail(std::size_t n) noexcept {
+	Budget * budget = current_budget;
+	if (n > 0 && budget) {
+		budget->charge(n * sizeof(Expression));
+	}
+}
+
+static void release_tail(std::size_t n) noexcept {
+	Budget * budget = current_budget;
+	if (n > 0 && budget) {
+		budget->release(n * sizeof(Expression));
+	}
+}
+
+// elements held outside any Expression, such as a result being built up,
+// charged while the guard lives
+struct TailCharge {
+	TailCharge(): count(0) {}
+	~TailCharge() { release_tail(count); }
 
-Expression::Expression(const Atom & a) {
+	void add() noexcept {
+		charge_tail(1);
+		++count;
+	}
+
+	std::size_t count;
+};
+
+Expression::Expression(): m_hash(0), m_purity(SideEffecting), m_memoized(false), m_cost(0) {}
+
+Expression::Expression(const Atom & a): m_hash(0), m_purity(SideEffecting), m_memoized(false), m_cost(0) {
   m_head = a;
 }
 
 // recursive copy
-Expression::Expression(const Expression & a) {
+Expression::Expression(const Expression & a):
+  m_hash(a.m_hash.load(std::memory_order_relaxed)), m_cost(a.m_cost.load(std::memory_order_relaxed)) {
 
   m_head = a.m_head;
   propmap = a.propmap;
-  for(auto e : a.m_tail){
+  m_seq = a.m_seq;
+  m_purity = a.m_purity;
+  m_reads = a.m_reads;
+  m_memoized = a.m_memoized;
+  m_future = a.m_future;
+  for(const auto & e : a.m_tail){
     m_tail.push_back(e);
   }
+  charge_tail(m_tail.size());
+}
+
+// move, a is left with its head and an empty tail
+Expression::Expression(Expression && a) noexcept:
+  m_tail(std::move(a.m_tail)), m_seq(std::move(a.m_seq)), propmap(std::move(a.propmap)),
+  m_hash(a.m_hash.load(std::memory_order_relaxed)), m_cost(a.m_cost.load(std::memory_order_relaxed)) {
+
+  m_head = a.m_head;
+  m_purity = a.m_purity;
+  m_reads = std::move(a.m_reads);
+  m_memoized = a.m_memoized;
+  m_future = std::move(a.m_future);
+  a.m_hash.store(0, std::memory_order_relaxed);
 }
 
 // constructor for list
-Expression::Expression(const std::vector<Expression> & a) {
+Expression::Expression(const std::vector<Expression> & a): m_hash(0), m_purity(SideEffecting), m_memoized(false), m_cost(0) {
 	m_head.setList();
 	m_tail = a;
+	charge_tail(m_tail.size());
 }
 
 // constructor for a lambda kind
-Expression::Expression(const Atom & a, const std::vector<Expression> & exp) {
+Expression::Expression(const Atom & a, const std::vector<Expression> & exp): m_hash(0), m_purity(SideEffecting), m_memoized(false), m_cost(0) {
 	m_head = a;
-	for (auto e : exp) {
+	for (const auto & e : exp) {
 		m_tail.push_back(e);
 	}
+	charge_tail(m_tail.size());
+}
+
+Expression::~Expression() {
+	release_tail(m_tail.size());
+}
+
+Expression Expression::restore(const Atom & head, std::vector<Expression> && tail,
+	const std::shared_ptr<const PropertyMap> & properties, Purity purity, bool memoized) {
+	Expression result(head);
+	result.m_tail = std::move(tail);
+	charge_tail(result.m_tail.size());
+	result.propmap = properties;
+	result.m_purity = purity;
+	result.m_memoized = memoized;
+	if (result.isHeadLambda()) {
+		result.cache_reads();
+	}
+	return result;
+}
+
+// factory for a lazy list, a constructor taking a pointer would make
+// Expression(0) ambiguous
+Expression Expression::fromSequence(const std::shared_ptr<const Sequence> & seq) {
+	Expression result;
+	result.m_head.setList();
+	result.m_seq = seq;
+	return result;
 }
 
 // Tests equality to one another
@@ -48,16 +135,47 @@ Expression & Expression::operator=(const Expression & a){
   if(this != &a){
     m_head = a.m_head;
 	propmap = a.propmap;
+	m_seq = a.m_seq;
+	m_purity = a.m_purity;
+	m_reads = a.m_reads;
+	m_memoized = a.m_memoized;
+	m_future = a.m_future;
+	m_hash.store(a.m_hash.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	m_cost.store(a.m_cost.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    release_tail(m_tail.size());
     m_tail.clear();
-    for(auto e : a.m_tail){
+    for(const auto & e : a.m_tail){
       m_tail.push_back(e);
     } 
+    charge_tail(m_tail.size());
   }
   
   return *this;
 }
 
+Expression & Expression::operator=(Expression && a) noexcept{
+
+  if(this != &a){
+    m_head = a.m_head;
+    release_tail(m_tail.size());
+    m_tail = std::move(a.m_tail);
+    m_seq = std::move(a.m_seq);
+    propmap = std::move(a.propmap);
+    m_purity = a.m_purity;
+    m_reads = std::move(a.m_reads);
+    m_memoized = a.m_memoized;
+    m_future = std::move(a.m_future);
+    m_hash.store(a.m_hash.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    m_cost.store(a.m_cost.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    a.m_hash.store(0, std::memory_order_relaxed);
+  }
+  return *this;
+}
+
 Atom & Expression::head(){
+  // the caller may change the head
+  m_hash.store(0, std::memory_order_relaxed);
+  m_cost.store(0, std::memory_order_relaxed);
   return m_head;
 }
 
@@ -65,6 +183,181 @@ const Atom & Expression::head() const{
   return m_head;
 }
 
+Purity Expression::purity() const noexcept{
+  return m_purity;
+}
+
+const std::vector<std::string> & Expression::reads() const noexcept{
+  static const std::vector<std::string> none;
+  return m_reads ? *m_reads : none;
+}
+
+void Expression::cache_reads(){
+  std::vector<std::string> names = lambda_reads(*this);
+  if (names.empty()) {
+    m_reads.reset();
+  }
+  else {
+    m_reads = std::make_shared<const std::vector<std::string>>(std::move(names));
+  }
+}
+
+bool Expression::memoized() const noexcept{
+  return m_memoized;
+}
+
+std::shared_ptr<const Expression::PropertyMap> Expression::properties() const noexcept{
+  return propmap;
+}
+
+// mix v into the running hash h
+static std::uint64_t hash_combine(std::uint64_t h, std::uint64_t v) noexcept{
+  v *= 0x9e3779b97f4a7c15ULL;
+  v ^= v >> 32;
+  return (h ^ v) * 0x100000001b3ULL;
+}
+
+static std::uint64_t hash_double(double d) noexcept{
+  // 0 and -0 compare equal so must hash equal
+  if(d == 0) d = 0;
+  std::uint64_t bits;
+  std::memcpy(&bits, &d, sizeof(bits));
+  return bits;
+}
+
+static std::uint64_t hash_atom(const Atom & a) noexcept{
+  std::hash<std::string> hash_string;
+  if(a.isNumber()) return hash_combine(1, hash_double(a.asNumber()));
+  if(a.isSymbol()) return hash_combine(2, hash_string(a.asSymbol()));
+  if(a.isComplex()) return hash_combine(hash_combine(3, hash_double(a.asComplex().real())), hash_double(a.asComplex().imag()));
+  if(a.isList()) return 4;
+  if(a.isLambda()) return 5;
+  if(a.isString()) return hash_combine(6, hash_string(a.asString()));
+  if(a.isDiscrete()) return 7;
+  if(a.isFuture()) return 8;
+  return 0;
+}
+
+std::uint64_t Expression::hash() const noexcept{
+
+  std::uint64_t h = m_hash.load(std::memory_order_relaxed);
+  if(h != 0){
+    return h;
+  }
+
+  h = hash_combine(hash_atom(m_head), tailSize());
+  // a lazy list hashes by its generator, producing its elements could take
+  // for ever. It hashes apart from the same list materialized.
+  if(m_seq){
+    h = hash_combine(h, m_seq->hash());
+  }
+  for(auto & e : m_tail){
+    h = hash_combine(h, e.hash());
+  }
+  if(propmap){
+    h = hash_combine(h, hash(*propmap));
+  }
+  // futures are only identical to copies of themselves
+  if(m_future){
+    h = hash_combine(h, reinterpret_cast<std::uintptr_t>(m_future.get()));
+  }
+  // zero marks a hash not computed yet
+  if(h == 0) h = 1;
+
+  // threads racing here store the same value
+  m_hash.store(h, std::memory_order_relaxed);
+  return h;
+}
+
+std::uint64_t Expression::hash(const PropertyMap & properties) noexcept{
+
+  std::uint64_t h = properties.size();
+  for(auto & p : properties){
+    h = hash_combine(h, std::hash<std::string>()(p.first));
+    h = hash_combine(h, p.second.hash());
+  }
+  return h;
+}
+
+const Expression & Expression::property(const std::string & key) const noexcept{
+
+  static const Expression none;
+  if(propmap){
+    auto found = propmap->find(key);
+    if(found != propmap->end()){
+      return found->second;
+    }
+  }
+  return none;
+}
+
+// bitwise comparison of numbers, unlike operator== which allows a tolerance
+static bool identical_double(double left, double right) noexcept{
+  return std::memcmp(&left, &right, sizeof(double)) == 0;
+}
+
+static bool identical_atom(const Atom & left, const Atom & right) noexcept{
+  if(left.isNumber() && right.isNumber()){
+    return identical_double(left.asNumber(), right.asNumber());
+  }
+  if(left.isComplex() && right.isComplex()){
+    return identical_double(left.asComplex().real(), right.asComplex().real()) &&
+      identical_double(left.asComplex().imag(), right.asComplex().imag());
+  }
+  return left == right;
+}
+
+bool Expression::identical(const Expression & exp) const noexcept{
+
+  if(this == &exp){
+    return true;
+  }
+  // identical expressions hash the same, so differing cached hashes settle
+  // it, unless a lazy list that hashes by its generator is involved
+  std::uint64_t left = m_hash.load(std::memory_order_relaxed);
+  std::uint64_t right = exp.m_hash.load(std::memory_order_relaxed);
+  if(left != 0 && right != 0 && left != right && !m_seq && !exp.m_seq){
+    return false;
+  }
+
+  if(!identical_atom(m_head, exp.m_head) || tailSize() != exp.tailSize() || m_future != exp.m_future){
+    return false;
+  }
+  if(m_seq || exp.m_seq){
+    // the same generator makes the same elements, others are produced and
+    // compared one by one, the elements of a list that is not lazy in place
+    bool same = m_seq && exp.m_seq && m_seq->same(*exp.m_seq);
+    for(std::size_t i = 0; !same && i < tailSize(); i++){
+      bool equal = !m_seq ? m_tail[i].identical(exp.m_seq->at(i)) :
+        exp.m_seq ? m_seq->at(i).identical(exp.m_seq->at(i)) : m_seq->at(i).identical(exp.m_tail[i]);
+      if(!equal){
+        return false;
+      }
+    }
+  }
+  else{
+    for(std::size_t i = 0; i < m_tail.size(); i++){
+      if(!m_tail[i].identical(exp.m_tail[i])){
+        return false;
+      }
+    }
+  }
+
+  // interned property maps are shared, so the pointers are usually enough
+  if(propmap == exp.propmap){
+    return true;
+  }
+  if(!propmap || !exp.propmap || propmap->size() != exp.propmap->size()){
+    return false;
+  }
+  for(auto l = propmap->begin(), r = exp.propmap->begin(); l != propmap->end(); ++l, ++r){
+    if(l->first != r->first || !l->second.identical(r->second)){
+      return false;
+    }
+  }
+  return true;
+}
+
 bool Expression::isHeadNumber() const noexcept{
   return m_head.isNumber();
 }
@@ -89,12 +382,22 @@ bool Expression::isHeadString() const noexcept {
 	return m_head.isString();
 }
 
+bool Expression::isHeadFuture() const noexcept {
+	return m_head.isFuture();
+}
+
 void Expression::append(const Atom & a){
+  m_hash.store(0, std::memory_order_relaxed);
+  m_cost.store(0, std::memory_order_relaxed);
   m_tail.emplace_back(a);
+  charge_tail(1);
 }
 
 Expression * Expression::tail(){
   Expression * ptr = nullptr;
+  m_hash.store(0, std::memory_order_relaxed);
+  m_cost.store(0, std::memory_order_relaxed);
+  materialize();
   
   if(m_tail.size() > 0){
     ptr = &m_tail.back();
@@ -103,14 +406,89 @@ Expression * Expression::tail(){
   return ptr;
 }
 
-Expression::ConstIteratorType Expression::tailConstBegin() const noexcept{
+Expression::ConstIteratorType Expression::tailConstBegin() const{
+  materialize();
   return m_tail.cbegin();
 }
 
-Expression::ConstIteratorType Expression::tailConstEnd() const noexcept{
+Expression::ConstIteratorType Expression::tailConstEnd() const{
+  materialize();
   return m_tail.cend();
 }
 
+std::size_t Expression::tailSize() const noexcept{
+  return m_seq ? m_seq->size() : m_tail.size();
+}
+
+Expression Expression::tailAt(std::size_t i) const{
+  return m_seq ? m_seq->at(i) : m_tail[i];
+}
+
+bool Expression::isLazy() const noexcept{
+  return static_cast<bool>(m_seq);
+}
+
+std::shared_ptr<const Sequence> Expression::sequence() const noexcept{
+  return m_seq;
+}
+
+void Expression::materialize() const{
+  if(m_seq){
+    // a list too big for the memory limit is never allocated. The error is
+    // thrown here, a list left lazy would read as empty to the caller.
+    if(current_budget){
+      current_budget->require(m_seq->size() * sizeof(Expression));
+    }
+    // built aside, so a cancelled evaluation leaves the list lazy
+    std::vector<Expression> tail;
+    tail.reserve(m_seq->size());
+    CancelPoll poll;
+    for(std::size_t i = 0; i < m_seq->size(); ++i){
+      poll.tick();
+      tail.push_back(m_seq->at(i));
+    }
+    charge_tail(tail.size());
+    m_tail.swap(tail);
+    m_seq.reset();
+    // lazy lists hash by their generator
+    m_hash.store(0, std::memory_order_relaxed);
+  }
+}
+
+// true if calls to lambda should go through the memo cache, either because
+// it was memoized or because it is pure and automatic memoization is on
+static bool use_memo(const Expression & lambda, const Environment & env) {
+	return lambda.memoized() || (lambda.purity() == Pure && env.runtime().autoMemoize());
+}
+
+// the values in env of the globals a call to lambda reads, unbound ones as
+// the empty expression. A memoized result holds only while they are the same.
+// The names come from the reads cached on lambda and the lambdas it calls.
+static std::vector<Expression> global_values(const Expression & lambda, const Environment & env) {
+	std::vector<Expression> values;
+	if (lambda.purity() == Pure) {
+		return values;
+	}
+	for (auto & read : global_reads(lambda, env)) {
+		values.push_back(read.second);
+	}
+	return values;
+}
+
+// evaluate the body of lambda, answering from the memo cache when the same
+// arguments were seen before. args ends with the global_values of lambda.
+static Expression memo_eval(Expression & body, Environment & env, const Expression & lambda, const std::vector<Expression> & args) {
+	MemoCache & memo = env.runtime().memo();
+	std::uint64_t key = MemoCache::key(lambda, args);
+	Expression result;
+	if (memo.lookup(key, lambda, args, result)) {
+		return result;
+	}
+	result = body.eval(env);
+	memo.insert(key, lambda, args, result);
+	return result;
+}
+
 Expression apply(const Atom & op, const std::vector<Expression> & args, const Environment & env){
 	// if it is a lambda
 	if (env.is_exp(op)) {
@@ -136,6 +514,13 @@ Expression apply(const Atom & op, const std::vector<Expression> & args, const En
 			newenv.add_exp(Atom((*e).head()), args[counter]);
 			counter++;
 		}
+		if (use_memo(exp, env)) {
+			std::vector<Expression> key = args;
+			for (auto & value : global_values(exp, env)) {
+				key.push_back(value);
+			}
+			return memo_eval(endexp, newenv, exp, key);
+		}
 		return endexp.eval(newenv);
 	}
 
@@ -157,6 +542,76 @@ Expression apply(const Atom & op, const std::vector<Expression> & args, const En
   return proc(args);
 }
 
+// A call frame for invoking the same procedure or lambda many times, as the
+// sequence forms do. A lambda's environment is copied once when the frame is
+// built and its parameters are rebound on each call, rather than copying the
+// whole environment for every element like apply does. The body runs on a
+// copy sharing those definitions, so a define in the body copies them first
+// and never reaches the next call.
+class CallFrame {
+public:
+	CallFrame(const Atom & op, const Environment & env) : m_env(env) {
+		m_lambda = env.is_exp(op);
+		m_memo = false;
+		if (m_lambda) {
+			Expression exp = env.get_exp(op);
+			Expression params = *exp.tailConstBegin();
+			m_body = *exp.tail();
+			for (auto e = params.tailConstBegin(); e != params.tailConstEnd(); e++) {
+				m_params.push_back(e->head());
+			}
+			// look up the globals the lambda reads once for every call
+			// through the frame, calls only rebind the parameters
+			m_memo = use_memo(exp, env);
+			if (m_memo) {
+				m_function = exp;
+				m_key.resize(m_params.size());
+				for (auto & value : global_values(exp, env)) {
+					m_key.push_back(value);
+				}
+			}
+		}
+		else {
+			// same checks as apply
+			if (!op.isSymbol()) {
+				throw SemanticError("Error during evaluation: procedure name not a symbol (apply)");
+			}
+			if (!env.is_proc(op)) {
+				throw SemanticError("Error during evaluation: symbol does not name a procedure (apply)");
+			}
+			m_proc = env.get_proc(op);
+		}
+	}
+
+	Expression call(const std::vector<Expression> & args) {
+		if (!m_lambda) {
+			return m_proc(args);
+		}
+		if (args.size() != m_params.size()) {
+			throw SemanticError("Error in call to procedure: invalid number of arguments.");
+		}
+		for (std::size_t i = 0; i < m_params.size(); i++) {
+			m_env.add_exp(m_params[i], args[i]);
+		}
+		Environment scope = m_env;
+		if (m_memo) {
+			std::copy(args.begin(), args.end(), m_key.begin());
+			return memo_eval(m_body, scope, m_function, m_key);
+		}
+		return m_body.eval(scope);
+	}
+
+private:
+	bool m_lambda;
+	bool m_memo;
+	Expression m_function;
+	std::vector<Expression> m_key;
+	Procedure m_proc;
+	Environment m_env;
+	std::vector<Atom> m_params;
+	Expression m_body;
+};
+
 Expression Expression::handle_lookup(const Atom & head, const Environment & env){
     if(head.isSymbol()){ // if symbol is in env return value
 		if(env.is_exp(head)){
@@ -225,6 +680,12 @@ Expression Expression::handle_define(Environment & env){
   // eval tail[1]
   Expression result = m_tail[1].eval(env);
 
+  // a lambda calling itself by the name it is defined as only reads that
+  // global, which was not known yet when the lambda was made
+  if (result.isHeadLambda() && result.m_purity != Pure) {
+    result.m_purity = classify_lambda(result, env, s);
+  }
+
   /*if(env.is_exp(m_head)){
     throw SemanticError("Error during evaluation: attempt to redefine a previously defined symbol");
   }*/
@@ -271,6 +732,9 @@ Expression Expression::handle_lambda(Environment & env) {
 	Expression result = Expression(allArgs);
 	// set lambda to true
 	result.head().setLambda();
+	// classify the body once, calls check the cached result
+	result.m_purity = classify_lambda(result, env);
+	result.cache_reads();
 	// return the result as a list followed by expression
 	return result;
 }
@@ -305,7 +769,9 @@ Expression Expression::handle_apply(Environment & env) {
 	if (env.is_exp(m_tail[0].head()))
 	{
 			// iterate through expression and push into vector of expressions
+			CancelPoll poll;
 			for (auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); e++) {
+				poll.tick();
 				args.push_back(*e);
 			}
 			// return the application of the vector to get the correct mathematical output
@@ -324,7 +790,9 @@ Expression Expression::handle_apply(Environment & env) {
 	}
 
 	// otherwise, iterate through the tail, and push onto vector of expressions args
+	CancelPoll poll;
 	for (auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); e++) {
+		poll.tick();
 		args.push_back(*e);
 	}
 
@@ -333,69 +801,418 @@ Expression Expression::handle_apply(Environment & env) {
 	return apply(op, args, env);
 }
 
-Expression Expression::handle_map(Environment & env) {
-	// evaluate the environment of tail[1] and set to expression
-	Expression exp = m_tail[1].eval(env);
-	std::vector<Expression> args;
-	std::vector<Expression> result;
-
-	// tail must have size 2 or error
-	if (m_tail.size() != 2) {
-		throw SemanticError("Error during evaluation: invalid number of lambda arguments to define");
-	}
+// one map or filter step of a fused pipeline
+struct PipelineStage {
+	bool filter;
+	Atom op;
+};
 
+// the first argument of map, filter and foldl must name a procedure or lambda
+static Atom stage_procedure(const Expression & fn, const Environment & env, const std::string & form) {
 	// tail[0] must be symbol
-	if (!m_tail[0].isHeadSymbol()) {
-		throw SemanticError("Error during evaluation: first argument to define not symbol");
+	if (!fn.isHeadSymbol()) {
+		throw SemanticError("Error during evaluation: first argument to " + form + " not symbol");
 	}
 
 	// but tail[0] must not be a special-form or procedure
-	std::string s = m_tail[0].head().asSymbol();
+	std::string s = fn.head().asSymbol();
 	if ((s == "define") || (s == "begin")) {
 		throw SemanticError("Error during evaluation: attempt to redefine a special-form");
 	}
 
-	// if the expression is not a list, throw error
+	// a lambda, or a procedure given without arguments
+	if (!env.is_exp(fn.head()) && (!env.is_proc(fn.head()) || fn.tailSize() != 0)) {
+		throw SemanticError("Error during evaluation: first argument to " + form + " not a procedure");
+	}
+	return fn.head();
+}
+
+// Walk down a chain of nested (map f ...) and (filter f ...) forms, recording
+// each as a stage (innermost first), and return the expression producing the
+// list at the bottom of the chain. Malformed links end the chain and are left
+// to report their own errors when evaluated.
+Expression & Expression::fused_source(std::vector<PipelineStage> & stages, const Environment & env) {
+	if (m_head.isSymbol() && m_tail.size() == 2 &&
+		((m_head.asSymbol() == "map") || (m_head.asSymbol() == "filter"))) {
+		try {
+			PipelineStage stage = { m_head.asSymbol() == "filter", stage_procedure(m_tail[0], env, m_head.asSymbol()) };
+			Expression & source = m_tail[1].fused_source(stages, env);
+			stages.push_back(stage);
+			return source;
+		}
+		catch (const SemanticError &) {
+		}
+	}
+	return *this;
+}
+
+// Push the elements [begin, end) of source through the stages in a single
+// loop and hand the survivors to sink, so chained map/filter never build
+// intermediate lists. When run as part of a group the loop stops with an
+// interrupted error once the group is cancelled.
+template<typename Sink>
+static void run_pipeline(const std::vector<PipelineStage> & stages, const Expression & source,
+	std::size_t begin, std::size_t end, const Environment & env, Sink sink, const TaskGroup * group = nullptr) {
+	// one frame per stage, reused for every element
+	std::vector<CallFrame> frames;
+	frames.reserve(stages.size());
+	for (auto & stage : stages) {
+		frames.emplace_back(stage.op, env);
+	}
+
+	std::vector<Expression> args(1);
+	TailCharge held;
+	CancelPoll poll;
+	for (std::size_t i = begin; i < end; i++) {
+		if (group && group->cancelled()) {
+			throw SemanticError("Error: interpreter kernel interrupted");
+		}
+		poll.tick();
+		if (current_budget) {
+			current_budget->step();
+		}
+		Expression value = source.tailAt(i);
+		bool keep = true;
+		for (std::size_t j = 0; j < stages.size(); j++) {
+			const PipelineStage & stage = stages[j];
+			args[0] = value;
+			Expression out = frames[j].call(args);
+			if (!stage.filter) {
+				value = out;
+			}
+			else if (!out.isHeadNumber()) {
+				throw SemanticError("Error during evaluation: filter predicate did not return a number");
+			}
+			else if (out.head().asNumber() == 0) {
+				keep = false;
+				break;
+			}
+		}
+		if (keep) {
+			held.add();
+			sink(value);
+		}
+	}
+}
+
+// evaluate the list at the bottom of a fused chain, it must be a list
+static Expression pipeline_source(Expression & source, Environment & env, const std::string & form) {
+	Expression exp = source.eval(env);
 	if (!exp.isHeadList()) {
-		throw SemanticError("Error during evaluation: second argument to map not a list");
+		throw SemanticError("Error during evaluation: second argument to " + form + " not a list");
 	}
+	return exp;
+}
 
-	// if the environment has an expression of lambda, iterate
-	if (env.is_exp(m_tail[0].head()))
-	{
-		// iterate through and push one by one into a temporary vector of expressions args. Take
-		// the application of the expression in args and push that onto the vector of expressions
-		// called result. Clear args and repeat to do the math to each number in the list unarilly
-		for (auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); e++) {
-			args.emplace_back(*e);
-			result.push_back(apply(m_tail[0].head(), args, env));
-			args.clear();
+// Run the stages over source on the shared thread pool. The list is split
+// into contiguous chunks; each task builds its own call frames and fills its
+// own part of the result, so the order is the same as a sequential map. The
+// first error stops the remaining chunks and is rethrown here.
+static Expression parallel_pipeline(const std::vector<PipelineStage> & stages, const Expression & source, const Environment & env) {
+	ThreadPool & pool = ThreadPool::shared();
+	std::size_t size = source.tailSize();
+	// a worker process has no pool threads, see in_map_worker
+	std::size_t chunks = in_map_worker() ? 1 : std::min<std::size_t>(size, pool.size() * 4);
+
+	// numeric results from worker processes are adopted without copying,
+	// anything else is mapped again on threads. The workers get a runtime of
+	// their own, whose memo and property locks no thread of ours can hold.
+	if (env.runtime().processParallel() && process_map_supported() && size > 0 && !in_map_worker()) {
+		Expression adopted;
+		Environment local = env.isolated();
+		auto work = [&stages, &source, &local](std::size_t begin, std::size_t end, const std::function<void(const Expression &)> & sink) {
+			run_pipeline(stages, source, begin, end, local, sink);
+		};
+		if (process_map(size, std::max(2u, pool.size()), work, adopted)) {
+			return adopted;
 		}
+	}
+
+	std::vector<Expression> result;
+	if (chunks <= 1) {
+		run_pipeline(stages, source, 0, size, env, [&result](const Expression & value) { result.push_back(value); });
 		return Expression(result);
 	}
 
-	// count tail size to ensure it is 0
-	int count = 0;
-	for (auto it = m_tail[0].tailConstBegin(); it != m_tail[0].tailConstEnd(); it++) {
-		count++;
+	std::vector<std::vector<Expression>> parts(chunks);
+	TaskGroup group(pool);
+	for (std::size_t c = 0; c < chunks; c++) {
+		std::size_t begin = size * c / chunks;
+		std::size_t end = size * (c + 1) / chunks;
+		std::vector<Expression> & part = parts[c];
+		group.run([&stages, &source, &env, &part, &group, begin, end]() {
+			part.reserve(end - begin);
+			run_pipeline(stages, source, begin, end, env, [&part](const Expression & value) { part.push_back(value); }, &group);
+		});
 	}
+	group.wait();
 
-	// if count is not 0, or not a procedure, throw error
-	if (!env.is_proc(m_tail[0].head()) || count != 0) {
-		throw SemanticError("Error during evaluation: first argument to map not a procedure");
+	result.reserve(size);
+	for (auto & part : parts) {
+		result.insert(result.end(), part.begin(), part.end());
 	}
+	return Expression(result);
+}
 
-	// otherwise, iterate just like the lambda function, but for a function that is not a lambda
-	for (auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); e++) {
-		args.emplace_back(*e);
-		result.push_back(apply(m_tail[0].head(), args, env));
-		args.clear();
+// lists at least this long are mapped on the thread pool when no stage has
+// side effects, shorter ones are not worth handing out
+static const std::size_t parallel_map_threshold = 2048;
+
+// true if every stage is a builtin or a lambda without side effects. The
+// purity a lambda cached is stale once a lambda it calls is redefined, so
+// any but a pure one is classified again as it is now.
+static bool parallel_safe(const std::vector<PipelineStage> & stages, const Environment & env) {
+	for (auto & stage : stages) {
+		if (!env.is_exp(stage.op)) {
+			continue;
+		}
+		Expression lambda = env.get_exp(stage.op);
+		if (lambda.purity() != Pure && classify_lambda(lambda, env, stage.op.asSymbol()) == SideEffecting) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// (map f list)
+// nested map and filter forms in the list argument are fused into this loop
+Expression Expression::handle_map(Environment & env) {
+	// tail must have size 2 or error
+	if (m_tail.size() != 2) {
+		throw SemanticError("Error during evaluation: invalid number of lambda arguments to define");
+	}
+	Atom op = stage_procedure(m_tail[0], env, "map");
+
+	std::vector<PipelineStage> stages;
+	Expression exp = pipeline_source(m_tail[1].fused_source(stages, env), env, "map");
+	bool filtered = false;
+	for (auto & stage : stages) {
+		filtered = filtered || stage.filter;
 	}
+	PipelineStage last = { false, op };
+	stages.push_back(last);
+
+	// long lists through lambdas that are safe to run concurrently go to pmap
+	if (exp.tailSize() >= parallel_map_threshold && !in_map_worker() && ThreadPool::shared().size() > 1 && parallel_safe(stages, env)) {
+		return parallel_pipeline(stages, exp, env);
+	}
+
+	// without a filter the result is exactly as long as the source
+	std::vector<Expression> result;
+	if (!filtered) {
+		result.reserve(exp.tailSize());
+	}
+	run_pipeline(stages, exp, 0, exp.tailSize(), env, [&result](const Expression & value) { result.push_back(value); });
 
 	// return the expression of result
 	return Expression(result);
 }
 
+// (memoize f)
+// returns the lambda f with calls to it going through the memo cache
+Expression Expression::handle_memoize(Environment & env) {
+	if (m_tail.size() != 1) {
+		throw SemanticError("Error during evaluation: invalid number of arguments to memoize");
+	}
+	Expression result = m_tail[0].eval(env);
+	if (!result.isHeadLambda()) {
+		throw SemanticError("Error during evaluation: argument to memoize not a lambda");
+	}
+	result.m_memoized = true;
+	return result;
+}
+
+// (spawn exp)
+// starts evaluating exp on the thread pool and returns a future for its value.
+// The task works on a snapshot of env taken now, so later definitions are not
+// seen by it and its definitions are not seen here. The task only holds on
+// to the future weakly, so it is cancelled once the future is dropped.
+// A worker process of a map has no pool, there exp is evaluated at once.
+Expression Expression::handle_spawn(Environment & env) {
+	if (m_tail.size() != 1) {
+		throw SemanticError("Error during evaluation: invalid number of arguments to spawn");
+	}
+	std::shared_ptr<Future> future = std::make_shared<Future>();
+	std::weak_ptr<Future> handle = future;
+	std::shared_ptr<Environment> snapshot = std::make_shared<Environment>(env);
+	std::shared_ptr<Expression> exp = std::make_shared<Expression>(m_tail[0]);
+
+	auto task = [handle, snapshot, exp]() {
+		Expression value;
+		std::exception_ptr error;
+		try {
+			value = exp->eval(*snapshot);
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+		std::shared_ptr<Future> future = handle.lock();
+		if (!future) {
+			return;
+		}
+		if (error && future->token().cancelled()) {
+			// not the interrupt of whoever awaits it
+			error = std::make_exception_ptr(SemanticError("Error during evaluation: spawned task was cancelled"));
+		}
+		if (error) {
+			future->set_error(error);
+		}
+		else {
+			future->set_value(value);
+		}
+	};
+	// submit runs the task under the token current here
+	CancelScope scope(future->token());
+	if (in_map_worker()) {
+		task();
+	}
+	else {
+		ThreadPool::shared().submit(task, future.get());
+	}
+
+	Expression result;
+	result.m_head.setFuture();
+	result.m_future = future;
+	return result;
+}
+
+// (await future) or (await (list future ...))
+// waits for spawned tasks and returns their values, rethrowing their errors
+Expression Expression::handle_await(Environment & env) {
+	if (m_tail.size() != 1) {
+		throw SemanticError("Error during evaluation: invalid number of arguments to await");
+	}
+	Expression exp = m_tail[0].eval(env);
+	if (exp.isHeadFuture() && exp.m_future) {
+		return exp.m_future->get();
+	}
+	if (!exp.isHeadList()) {
+		throw SemanticError("Error during evaluation: argument to await not a future");
+	}
+
+	std::vector<Expression> result;
+	result.reserve(exp.tailSize());
+	for (std::size_t i = 0; i < exp.tailSize(); i++) {
+		Expression e = exp.tailAt(i);
+		if (!e.isHeadFuture() || !e.m_future) {
+			throw SemanticError("Error during evaluation: argument to await not a future");
+		}
+		result.push_back(e.m_future->get());
+	}
+	return Expression(result);
+}
+
+// (pmap f list)
+// map evaluated in parallel, nested map and filter forms are fused as for map
+Expression Expression::handle_pmap(Environment & env) {
+	if (m_tail.size() != 2) {
+		throw SemanticError("Error during evaluation: invalid number of arguments to pmap");
+	}
+	Atom op = stage_procedure(m_tail[0], env, "pmap");
+
+	std::vector<PipelineStage> stages;
+	Expression exp = pipeline_source(m_tail[1].fused_source(stages, env), env, "pmap");
+	PipelineStage last = { false, op };
+	stages.push_back(last);
+
+	return parallel_pipeline(stages, exp, env);
+}
+
+// (filter f list)
+// keeps the elements for which f returns a non-zero number
+Expression Expression::handle_filter(Environment & env) {
+	if (m_tail.size() != 2) {
+		throw SemanticError("Error during evaluation: invalid number of arguments to filter");
+	}
+	Atom op = stage_procedure(m_tail[0], env, "filter");
+
+	std::vector<PipelineStage> stages;
+	Expression exp = pipeline_source(m_tail[1].fused_source(stages, env), env, "filter");
+	PipelineStage last = { true, op };
+	stages.push_back(last);
+
+	std::vector<Expression> result;
+	run_pipeline(stages, exp, 0, exp.tailSize(), env, [&result](const Expression & value) { result.push_back(value); });
+	return Expression(result);
+}
+
+// (foldl f init list)
+// calls (f acc x) left to right over the list, returns the final acc
+Expression Expression::handle_foldl(Environment & env) {
+	if (m_tail.size() != 3) {
+		throw SemanticError("Error during evaluation: invalid number of arguments to foldl");
+	}
+	Atom op = stage_procedure(m_tail[0], env, "foldl");
+	Expression acc = m_tail[1].eval(env);
+
+	std::vector<PipelineStage> stages;
+	Expression exp = pipeline_source(m_tail[2].fused_source(stages, env), env, "foldl");
+
+	CallFrame frame(op, env);
+	std::vector<Expression> args(2);
+	run_pipeline(stages, exp, 0, exp.tailSize(), env, [&](const Expression & value) {
+		args[0] = acc;
+		args[1] = value;
+		acc = frame.call(args);
+	});
+	return acc;
+}
+
+// (foldr f init list)
+// calls (f x acc) right to left over the list, returns the final acc
+Expression Expression::handle_foldr(Environment & env) {
+	if (m_tail.size() != 3) {
+		throw SemanticError("Error during evaluation: invalid number of arguments to foldr");
+	}
+	Atom op = stage_procedure(m_tail[0], env, "foldr");
+	Expression acc = m_tail[1].eval(env);
+	Expression exp = pipeline_source(m_tail[2], env, "foldr");
+
+	CallFrame frame(op, env);
+	std::vector<Expression> args(2);
+	CancelPoll poll;
+	for (std::size_t i = exp.tailSize(); i > 0; i--) {
+		poll.tick();
+		if (current_budget) {
+			current_budget->step();
+		}
+		args[0] = exp.tailAt(i - 1);
+		args[1] = acc;
+		acc = frame.call(args);
+	}
+	return acc;
+}
+
+// (reduce f list)
+// foldl seeded with the first element, the list must not be empty
+Expression Expression::handle_reduce(Environment & env) {
+	if (m_tail.size() != 2) {
+		throw SemanticError("Error during evaluation: invalid number of arguments to reduce");
+	}
+	Atom op = stage_procedure(m_tail[0], env, "reduce");
+
+	std::vector<PipelineStage> stages;
+	Expression exp = pipeline_source(m_tail[1].fused_source(stages, env), env, "reduce");
+
+	CallFrame frame(op, env);
+	std::vector<Expression> args(2);
+	bool empty = true;
+	run_pipeline(stages, exp, 0, exp.tailSize(), env, [&](const Expression & value) {
+		if (empty) {
+			args[0] = value;
+			empty = false;
+		}
+		else {
+			args[1] = value;
+			args[0] = frame.call(args);
+		}
+	});
+	if (empty) {
+		throw SemanticError("Error during evaluation: reduce of an empty list");
+	}
+	return args[0];
+}
+
 // Sets the property as the value and key
 Expression Expression::handle_set(Environment & env) {
 	// lambda tail must be of size 2
@@ -411,7 +1228,15 @@ Expression Expression::handle_set(Environment & env) {
 	std::string key = m_tail[0].head().asString();
 	Expression eval = m_tail[1].eval(env);
 
-	exp.propmap[key] = eval;
+	// copy the properties rather than change a map other expressions share
+	std::shared_ptr<PropertyMap> properties = exp.propmap ?
+		std::make_shared<PropertyMap>(*exp.propmap) : std::make_shared<PropertyMap>();
+	(*properties)[key] = eval;
+	exp.propmap = properties;
+	if (env.runtime().hashConsing()) {
+		exp.propmap = env.runtime().interner().intern(exp.propmap);
+	}
+	exp.m_hash.store(0, std::memory_order_relaxed);
 
 	return exp;
 }
@@ -430,7 +1255,7 @@ Expression Expression::handle_get(Environment & env) {
 	Expression exp = m_tail[1].eval(env);
 	std::string key = m_tail[0].head().asString();
 
-	return exp.propmap[key];
+	return exp.property(key);
 }
 
 // returns discrete plot information as required
@@ -461,11 +1286,13 @@ Expression Expression::handle_discrete(Environment & env) {
 	double yMin = 5000;
 
 	// Iterate through the lists to find the maxes and mins
+	CancelPoll poll;
 	for (auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); ++e) {
-		xMax = std::max((*e).m_tail[0].head().asNumber(), xMax);
-		xMin = std::min((*e).m_tail[0].head().asNumber(), xMin);
-		yMax = std::max((*e).m_tail[1].head().asNumber(), yMax);
-		yMin = std::min((*e).m_tail[1].head().asNumber(), yMin);
+		poll.tick();
+		xMax = std::max(e->tailAt(0).head().asNumber(), xMax);
+		xMin = std::min(e->tailAt(0).head().asNumber(), xMin);
+		yMax = std::max(e->tailAt(1).head().asNumber(), yMax);
+		yMin = std::min(e->tailAt(1).head().asNumber(), yMin);
 	}
 
 	// Find the x and y scale values
@@ -508,9 +1335,10 @@ Expression Expression::handle_discrete(Environment & env) {
 	std::vector<Expression> tempLine2;
 	std::vector<Expression> Results;
 
-	for(auto & pointpos : exp.m_tail) {
-		xpos = pointpos.m_tail[0].head().asNumber() * xScale;
-		ypos = pointpos.m_tail[1].head().asNumber() * yScale;
+	for (auto p = exp.tailConstBegin(); p != exp.tailConstEnd(); ++p) {
+		xpos = p->tailAt(0).head().asNumber() * xScale;
+		ypos = p->tailAt(1).head().asNumber() * yScale;
+		poll.tick();
 		ypos *= -1;
 		// push back for point
 		tempPoint.push_back(Expression(Atom(xpos)));
@@ -655,6 +1483,7 @@ Expression Expression::handle_discrete(Environment & env) {
 
 	// Iterate through m_tail[1] and add all variables to the results array
 	for (auto h = last.tailConstBegin(); h != last.tailConstEnd(); ++h) {
+		poll.tick();
 		Results.push_back(Expression((*h).m_tail[1].head().asString()));
 	}
 
@@ -663,17 +1492,296 @@ Expression Expression::handle_discrete(Environment & env) {
 }
 
 
+// the numeric bounds of a counting loop, validated the same way as range.
+// The counter takes the values start + k * step for k below count, exactly
+// the elements of (range start end step).
+struct CounterBounds {
+	double start;
+	double end;
+	double step;
+	std::size_t count;
+};
+
+// evaluate and check the start, end and increment of a counting loop
+static CounterBounds counter_bounds(Expression & start, Expression & end, Expression & step, Environment & env) {
+	Expression e = start.eval(env);
+	Expression f = end.eval(env);
+	Expression g = step.eval(env);
+	if (!e.isHeadNumber() || !f.isHeadNumber() || !g.isHeadNumber()) {
+		throw SemanticError("Error during evaluation: loop bounds are not numbers");
+	}
+	CounterBounds bounds = { e.head().asNumber(), f.head().asNumber(), g.head().asNumber(), 0 };
+	if (bounds.step <= 0) {
+		throw SemanticError("Error during evaluation: negative or zero increment in loop");
+	}
+	if (bounds.start >= bounds.end) {
+		throw SemanticError("Error during evaluation: begin greater than end in loop");
+	}
+	bounds.count = RangeSequence::count(bounds.start, bounds.end, bounds.step);
+	return bounds;
+}
+
+// the loop variable must be a plain symbol that is not a built-in procedure
+static std::string loop_symbol(const Expression & var, const Environment & env) {
+	if (!var.isHeadSymbol() || env.is_proc(var.head())) {
+		throw SemanticError("Error during evaluation: loop variable is not a symbol");
+	}
+	std::string s = var.head().asSymbol();
+	if ((s == "define") || (s == "begin")) {
+		throw SemanticError("Error during evaluation: attempt to redefine a special-form");
+	}
+	return s;
+}
+
+// (for (i start end step) body)
+// evaluates body once for every value of the counter, returns the last result
+Expression Expression::handle_for(Environment & env) {
+	// tail must have size 2 and the counter must have a start, end and step
+	if (m_tail.size() != 2) {
+		throw SemanticError("Error during evaluation: invalid number of arguments to for");
+	}
+	if (m_tail[0].m_tail.size() != 3) {
+		throw SemanticError("Error during evaluation: for counter must be (symbol start end step)");
+	}
+	std::string var = loop_symbol(m_tail[0], env);
+	CounterBounds bounds = counter_bounds(m_tail[0].m_tail[0], m_tail[0].m_tail[1], m_tail[0].m_tail[2], env);
+
+	// the counter lives in a single scratch environment that is reused by
+	// every iteration, so the loop runs in constant memory
+	Environment loopenv = env;
+	Atom counter(var);
+	Expression result;
+	for (std::size_t k = 0; k < bounds.count; k++) {
+		loopenv.add_exp(counter, Expression(bounds.start + k * bounds.step));
+		result = m_tail[1].eval(loopenv);
+	}
+	return result;
+}
+
+// (do (acc init) (i start end step) body)
+// the value of body becomes the next value of acc, returns the final acc
+Expression Expression::handle_do(Environment & env) {
+	if (m_tail.size() != 3) {
+		throw SemanticError("Error during evaluation: invalid number of arguments to do");
+	}
+	if (m_tail[0].m_tail.size() != 1) {
+		throw SemanticError("Error during evaluation: do accumulator must be (symbol init)");
+	}
+	if (m_tail[1].m_tail.size() != 3) {
+		throw SemanticError("Error during evaluation: do counter must be (symbol start end step)");
+	}
+	std::string acc = loop_symbol(m_tail[0], env);
+	std::string var = loop_symbol(m_tail[1], env);
+	if (acc == var) {
+		throw SemanticError("Error during evaluation: do accumulator and counter share a name");
+	}
+	Expression result = m_tail[0].m_tail[0].eval(env);
+	CounterBounds bounds = counter_bounds(m_tail[1].m_tail[0], m_tail[1].m_tail[1], m_tail[1].m_tail[2], env);
+
+	Environment loopenv = env;
+	Atom accumulator(acc);
+	Atom counter(var);
+	for (std::size_t k = 0; k < bounds.count; k++) {
+		loopenv.add_exp(accumulator, result);
+		loopenv.add_exp(counter, Expression(bounds.start + k * bounds.step));
+		result = m_tail[2].eval(loopenv);
+	}
+	return result;
+}
+
+// (fold-range f init start end step)
+// calls (f acc i) for every value of the counter, returns the final acc
+Expression Expression::handle_fold_range(Environment & env) {
+	if (m_tail.size() != 5) {
+		throw SemanticError("Error during evaluation: invalid number of arguments to fold-range");
+	}
+	// tail[0] must name a procedure or lambda, just like map
+	if (!m_tail[0].isHeadSymbol() || !m_tail[0].m_tail.empty()) {
+		throw SemanticError("Error during evaluation: first argument to fold-range not a procedure");
+	}
+	Atom op = m_tail[0].head();
+	if (!env.is_proc(op) && !env.is_exp(op)) {
+		throw SemanticError("Error during evaluation: first argument to fold-range not a procedure");
+	}
+	Expression result = m_tail[1].eval(env);
+	CounterBounds bounds = counter_bounds(m_tail[2], m_tail[3], m_tail[4], env);
+
+	// the frame and argument vector are reused between calls, only the values change
+	CallFrame frame(op, env);
+	std::vector<Expression> args(2);
+	CancelPoll poll;
+	for (std::size_t k = 0; k < bounds.count; k++) {
+		poll.tick();
+		if (current_budget) {
+			current_budget->step();
+		}
+		args[0] = result;
+		args[1] = Expression(bounds.start + k * bounds.step);
+		result = frame.call(args);
+	}
+	return result;
+}
+
+// arguments estimated to cost at least this many evaluations are worth
+// handing to another thread when parallel arguments are on
+static const std::size_t parallel_argument_cost = 4096;
+
+// a guess at the length of the list exp evaluates to, exact for short literal
+// ranges and bound lists
+static std::size_t estimate_length(const Expression & exp, const Environment & env) {
+	if (exp.isHeadSymbol() && exp.tailSize() == 0 && env.is_exp(exp.head())) {
+		return env.get_exp(exp.head()).tailSize();
+	}
+	if (!exp.isHeadSymbol()) {
+		return 16;
+	}
+	const std::string & name = exp.head().asSymbol();
+	if (name == "list") {
+		return exp.tailSize();
+	}
+	if (name == "range" && exp.tailSize() == 3) {
+		Expression begin = exp.tailAt(0), end = exp.tailAt(1), step = exp.tailAt(2);
+		if (begin.isHeadNumber() && end.isHeadNumber() && step.isHeadNumber() &&
+			step.head().asNumber() > 0 && end.head().asNumber() >= begin.head().asNumber()) {
+			double steps = (end.head().asNumber() - begin.head().asNumber()) / step.head().asNumber();
+			// converting a number too big for a size_t is undefined
+			return steps < parallel_argument_cost ? static_cast<std::size_t>(steps) + 1 : parallel_argument_cost;
+		}
+	}
+	if ((name == "map" || name == "pmap" || name == "filter") && exp.tailSize() == 2) {
+		return estimate_length(exp.tailAt(1), env);
+	}
+	return 16;
+}
+
+// a rough count of the nodes evaluating exp visits, only used to tell cheap
+// arguments from expensive ones. Calls to lambdas are followed a few levels.
+static std::size_t estimate_cost(const Expression & exp, const Environment & env, int depth = 0) {
+	std::size_t cost = 1;
+	for (auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); ++e) {
+		cost += estimate_cost(*e, env, depth);
+	}
+	if (!exp.isHeadSymbol() || depth > 4) {
+		return cost;
+	}
+
+	// the cost of calling the procedure or lambda named by fn once
+	auto call_cost = [&env, depth](const Expression & fn) -> std::size_t {
+		if (fn.isHeadSymbol() && env.is_exp(fn.head())) {
+			Expression lambda = env.get_exp(fn.head());
+			if (lambda.isHeadLambda() && lambda.tailSize() == 2) {
+				return estimate_cost(lambda.tailAt(1), env, depth + 1);
+			}
+		}
+		return 1;
+	};
+
+	const std::string & name = exp.head().asSymbol();
+	if ((name == "map" || name == "pmap" || name == "filter" || name == "foldr" || name == "reduce") && exp.tailSize() >= 2) {
+		cost += call_cost(exp.tailAt(0)) * estimate_length(exp.tailAt(exp.tailSize() - 1), env);
+	}
+	else if (name == "foldl" && exp.tailSize() == 3) {
+		cost += call_cost(exp.tailAt(0)) * estimate_length(exp.tailAt(2), env);
+	}
+	else if (exp.tailSize() > 0) {
+		cost += call_cost(Expression(exp.head())) - 1;
+	}
+	return cost;
+}
+
+std::size_t Expression::estimatedCost(const Environment & env) const{
+	std::uint16_t cost = m_cost.load(std::memory_order_relaxed);
+	if (cost == 0) {
+		// saturated, the cost is only compared with parallel_argument_cost
+		cost = static_cast<std::uint16_t>(std::min<std::size_t>(estimate_cost(*this, env), 0xffff));
+		m_cost.store(cost, std::memory_order_relaxed);
+	}
+	return cost;
+}
+
+// Evaluate the arguments of a procedure call into results, handing the
+// expensive ones to the thread pool. Only done when no argument has side
+// effects, so no argument can see another's definitions; each task gets its
+// own copy of env. Returns false, having evaluated nothing, if the arguments
+// should be evaluated in order on this thread.
+static bool parallel_arguments(std::vector<Expression> & args, std::vector<Expression> & results, Environment & env) {
+	if (!env.runtime().parallelArguments() || args.size() < 2 || in_map_worker()) {
+		return false;
+	}
+	// cheap path, calls with fewer than two compound arguments stay here
+	std::size_t compound = 0;
+	for (auto & arg : args) {
+		compound += arg.tailSize() > 0 ? 1 : 0;
+	}
+	if (compound < 2) {
+		return false;
+	}
+
+	std::vector<bool> expensive(args.size());
+	std::size_t count = 0;
+	for (std::size_t i = 0; i < args.size(); i++) {
+		expensive[i] = args[i].estimatedCost(env) >= parallel_argument_cost;
+		count += expensive[i] ? 1 : 0;
+	}
+	if (count < 2) {
+		return false;
+	}
+	for (auto & arg : args) {
+		if (classify_expression(arg, env) == SideEffecting) {
+			return false;
+		}
+	}
+
+	results.resize(args.size());
+	TaskGroup group(ThreadPool::shared());
+
+	// the last expensive argument and the cheap ones run on this thread
+	std::size_t last = args.size();
+	while (!expensive[--last]) {}
+	for (std::size_t i = 0; i < args.size(); i++) {
+		if (expensive[i] && i != last) {
+			std::shared_ptr<Environment> local = std::make_shared<Environment>(env);
+			Expression & arg = args[i];
+			Expression & result = results[i];
+			// the task runs under the group's token, so its evaluation stops at
+			// the next step once another argument failed or the call was cancelled
+			group.run([local, &arg, &result]() { result = arg.eval(*local); });
+		}
+	}
+	for (std::size_t i = 0; i < args.size() && !group.cancelled(); i++) {
+		if (!expensive[i] || i == last) {
+			results[i] = args[i].eval(env);
+		}
+	}
+	group.wait();
+	// cancelled without a task failing, some results were never computed
+	if (group.cancelled()) {
+		throw SemanticError("Error: interpreter kernel interrupted");
+	}
+	return true;
+}
+
 // this is a simple recursive version. the iterative version is more
 // difficult with the last data structure used (no parent pointer).
 // this limits the practical depth of our AST
 Expression Expression::eval(Environment & env){
-	if (global_status_flag > 0) {
+	if (cancellation_requested()) {
 		throw SemanticError("Error: interpreter kernel interrupted");
 	}
+	if (current_budget) {
+		current_budget->step();
+	}
 	if(m_tail.empty()){
 		if (m_head.isSymbol() && (m_head.asSymbol() == "list")) {
 			return Expression(m_tail);
 		}
+		// (memo-stats) lists the hits, misses, evictions, entries and bytes
+		if (m_head.isSymbol() && (m_head.asSymbol() == "memo-stats")) {
+			MemoStats stats = env.runtime().memo().stats();
+			std::vector<Expression> result = { Expression(double(stats.hits)), Expression(double(stats.misses)),
+				Expression(double(stats.evictions)), Expression(double(stats.entries)), Expression(double(stats.bytes)) };
+			return Expression(result);
+		}
 		return handle_lookup(m_head, env);
 	}
 	// handle begin special-form
@@ -695,6 +1803,30 @@ Expression Expression::eval(Environment & env){
 	else if (m_head.isSymbol() && m_head.asSymbol() == "map") {
 		return handle_map(env);
 	}
+	else if (m_head.isSymbol() && m_head.asSymbol() == "pmap") {
+		return handle_pmap(env);
+	}
+	else if (m_head.isSymbol() && m_head.asSymbol() == "memoize") {
+		return handle_memoize(env);
+	}
+	else if (m_head.isSymbol() && m_head.asSymbol() == "spawn") {
+		return handle_spawn(env);
+	}
+	else if (m_head.isSymbol() && m_head.asSymbol() == "await") {
+		return handle_await(env);
+	}
+	else if (m_head.isSymbol() && m_head.asSymbol() == "filter") {
+		return handle_filter(env);
+	}
+	else if (m_head.isSymbol() && m_head.asSymbol() == "foldl") {
+		return handle_foldl(env);
+	}
+	else if (m_head.isSymbol() && m_head.asSymbol() == "foldr") {
+		return handle_foldr(env);
+	}
+	else if (m_head.isSymbol() && m_head.asSymbol() == "reduce") {
+		return handle_reduce(env);
+	}
 	else if (m_head.isSymbol() && m_head.asSymbol() == "set-property") {
 		return handle_set(env);
 	}
@@ -704,18 +1836,28 @@ Expression Expression::eval(Environment & env){
 	else if (m_head.isSymbol() && m_head.asSymbol() == "discrete-plot") {
 		return handle_discrete(env);
 	}
+	else if (m_head.isSymbol() && m_head.asSymbol() == "for") {
+		return handle_for(env);
+	}
+	else if (m_head.isSymbol() && m_head.asSymbol() == "do") {
+		return handle_do(env);
+	}
+	else if (m_head.isSymbol() && m_head.asSymbol() == "fold-range") {
+		return handle_fold_range(env);
+	}
 	// else attempt to treat as procedure
 	else{ 
 		std::vector<Expression> results;
-		for(Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it){
-		results.push_back(it->eval(env));
+		if (!parallel_arguments(m_tail, results, env)) {
+			for(Expression::IteratorType it = m_tail.begin(); it != m_tail.end(); ++it){
+			results.push_back(it->eval(env));
+			}
 		}
 		return apply(m_head, results, env);
 	}
 }
 
 std::ostream & operator<<(std::ostream & out, const Expression & exp){
-	Environment env;
 	if (!exp.isHeadList() && exp.head().isNone()) {
 		out << "NONE";
 	}
@@ -725,7 +1867,7 @@ std::ostream & operator<<(std::ostream & out, const Expression & exp){
 		}
 
 		// If the expression head is a procedure and is not lambda, add a space to output
-		if (env.is_proc(exp.head()) && exp.isHeadSymbol() && (exp.head().asSymbol() != "lambda")) {
+		if (Environment::is_builtin_proc(exp.head()) && (exp.head().asSymbol() != "lambda")) {
 			out << exp.head();
 			out << " ";
 		}
@@ -748,8 +1890,7 @@ std::ostream & operator<<(std::ostream & out, const Expression & exp){
   return out;
 }
 
-std::string Expression::transferString() const noexcept{
-	Environment env;
+std::string Expression::transferString() const{
 	std::string text;
 
 	if (!this->isHeadList() && this->head().isNone()) {
@@ -774,32 +1915,19 @@ std::string Expression::transferString() const noexcept{
 	return text;
 }
 
-bool Expression::isPoint() const noexcept {
+bool Expression::isPoint() const {
 	Expression exp(Atom("\"point\""));
-	for (auto &e : propmap) {
-		if (e.first == "\"object-name\"") {
-			if (e.second == exp) {
-				return true;
-			}
-		}
-	}
-	return false;
+	return property("\"object-name\"") == exp;
 }
 
-bool Expression::isLine() const noexcept{
+bool Expression::isLine() const{
 	Expression exp(Atom("\"line\""));
-	if ((propmap.find("\"object-name\"") != propmap.end()) && propmap.at("\"object-name\"") == exp) {
-		return true;
-	}
-	return false;
+	return property("\"object-name\"") == exp;
 }
 
-bool Expression::isText() const noexcept{
+bool Expression::isText() const{
 	Expression exp(Atom("\"text\""));
-	if ((propmap.find("\"object-name\"") != propmap.end()) && propmap.at("\"object-name\"") == exp) {
-		return true;
-	}
-	return false;
+	return property("\"object-name\"") == exp;
 }
 
 double Expression::pointTail0() const noexcept{
@@ -810,30 +1938,30 @@ double Expression::pointTail1() const noexcept{
 	return m_tail[1].head().asNumber();
 }
 
-Expression Expression::req() const noexcept {
+Expression Expression::req() const {
 	Expression point(Atom("\"point\""));
 	Expression line(Atom("\"line\""));
 	Expression text(Atom("\"text\""));
 	Expression exp;
-	if ((propmap.find("\"object-name\"") != propmap.end()) && propmap.at("\"object-name\"") == point) {
-		return propmap.at("\"size\"");
+	if (property("\"object-name\"") == point) {
+		return property("\"size\"");
 	}
-	if ((propmap.find("\"object-name\"") != propmap.end()) && propmap.at("\"object-name\"") == line) {
-		return propmap.at("\"thickness\"");
+	if (property("\"object-name\"") == line) {
+		return property("\"thickness\"");
 	}
-	if ((propmap.find("\"object-name\"") != propmap.end()) && propmap.at("\"object-name\"") == text) {
-		return propmap.at("\"text-scale\"");
+	if (property("\"object-name\"") == text) {
+		return property("\"text-scale\"");
 	}
 	return exp;
 }
 
 Expression Expression::textReq() const noexcept{
-		return propmap.at("\"position\"");
+		return property("\"position\"");
 }
 
 double Expression::textRotReq() const noexcept {
 	// need to convert from radian to degree
-	return propmap.at("\"text-rotation\"").head().asNumber();
+	return property("\"text-rotation\"").head().asNumber();
 }
 
 double Expression::lineTail0x() const noexcept {
@@ -852,9 +1980,12 @@ double Expression::lineTail1y() const noexcept {
 	return m_tail[1].m_tail[1].head().asNumber();
 }
 
-bool Expression::operator==(const Expression & exp) const noexcept{
+bool Expression::operator==(const Expression & exp) const{
+
+  materialize();
+  exp.materialize();
 
-  bool result = (m_head == exp.m_head);
+  bool result = (m_head == exp.m_head) && (m_future == exp.m_future);
 
   result = result && (m_tail.size() == exp.m_tail.size());
 
@@ -869,13 +2000,13 @@ bool Expression::operator==(const Expression & exp) const noexcept{
   return result;
 }
 
-bool operator!=(const Expression & left, const Expression & right) noexcept{
+bool operator!=(const Expression & left, const Expression & right){
 
   return !(left == right);
 }
 
 
-std::vector<Expression> Expression::getTail() const noexcept {
+std::vector<Expression> Expression::getTail() const {
 	std::vector<Expression> tailpos;
 	for (auto f = this->tailConstBegin(); f != this->tailConstEnd(); f++) {
 		tailpos.push_back(*f);
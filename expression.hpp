@@ -7,17 +7,28 @@ Defines the Expression type and assiciated functions.
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <atomic>
 #include <csignal>
 #include <cstdlib>
+#include <cstdint>
 
 #include "token.hpp"
 #include "atom.hpp"
+#include "sequence.hpp"
+#include "purity.hpp"
 
 extern volatile sig_atomic_t global_status_flag;
 
 // forward declare Environment
 class Environment;
 
+// forward declare a stage of a fused map/filter pipeline
+struct PipelineStage;
+
+// forward declare the state of a spawned task
+class Future;
+
 /*! \class Expression
 \brief An expression is a tree of Atoms.
 
@@ -29,6 +40,9 @@ public:
 
   typedef std::vector<Expression>::const_iterator ConstIteratorType;
 
+  /// the properties of an expression, shared between copies
+  typedef std::map<std::string, Expression> PropertyMap;
+
   /// Default construct and Expression, whose type in NoneType
   Expression();
 
@@ -40,15 +54,32 @@ public:
   /// deep-copy construct an expression (recursive)
   Expression(const Expression & a);
 
+  /// move construct, taking the tail and properties of a without copying
+  Expression(Expression && a) noexcept;
+
+  /// release the tail, returning it to the memory budget of the running evaluation
+  ~Expression();
+
   /// deep-copy construct of vector expression
   Expression(const std::vector<Expression> & a);
 
   /// deep-copy constructor of atom and vector expression
   Expression(const Atom & a, const std::vector<Expression> & exp);
 
+  /// construct a list whose elements are produced on demand by seq
+  static Expression fromSequence(const std::shared_ptr<const Sequence> & seq);
+
+  /// reassemble an expression saved in a snapshot, with the properties and
+  /// lambda classification it had when it was saved
+  static Expression restore(const Atom & head, std::vector<Expression> && tail,
+    const std::shared_ptr<const PropertyMap> & properties, Purity purity, bool memoized);
+
   /// deep-copy assign an expression  (recursive)
   Expression & operator=(const Expression & a);
 
+  /// move assign, taking the tail and properties of a without copying
+  Expression & operator=(Expression && a) noexcept;
+
   /// return a reference to the head Atom
   Atom & head();
 
@@ -61,11 +92,56 @@ public:
   /// return a pointer to the last expression in the tail, or nullptr
   Expression * tail();
 
-  /// return a const-iterator to the beginning of tail
-  ConstIteratorType tailConstBegin() const noexcept;
+  /// return a const-iterator to the beginning of tail, materializing a lazy tail
+  /// \throws LimitError if the lazy tail does not fit the memory limit, or
+  /// SemanticError if the evaluation is cancelled while it is produced
+  ConstIteratorType tailConstBegin() const;
+
+  /// return a const-iterator to the tail end, materializing a lazy tail
+  ConstIteratorType tailConstEnd() const;
+
+  /// the number of tail elements, without materializing a lazy tail
+  std::size_t tailSize() const noexcept;
+
+  /// the tail element at index i, without materializing a lazy tail. The
+  /// copy allocates, so it may throw; i must be less than tailSize().
+  Expression tailAt(std::size_t i) const;
+
+  /// convenience member to determine if the tail is produced on demand
+  bool isLazy() const noexcept;
+
+  /// return the sequence producing a lazy tail, or nullptr
+  std::shared_ptr<const Sequence> sequence() const noexcept;
+
+  /// what the body of a lambda may depend on, SideEffecting for other expressions
+  Purity purity() const noexcept;
+
+  /// the symbols the body of a lambda looks up when called, see lambda_reads;
+  /// empty for other expressions
+  const std::vector<std::string> & reads() const noexcept;
+
+  /// true if calls to this lambda go through the memo cache
+  bool memoized() const noexcept;
 
-  /// return a const-iterator to the tail end
-  ConstIteratorType tailConstEnd() const noexcept;
+  /// the property map, null when there are no properties
+  std::shared_ptr<const PropertyMap> properties() const noexcept;
+
+  /*! A rough count of the nodes evaluating this expression visits, used to
+    tell arguments worth evaluating on another thread from cheap ones. It is
+    worked out once, from the lambdas bound in env at the time, and kept.
+    Values past 65535 are reported as 65535.
+   */
+  std::size_t estimatedCost(const Environment & env) const;
+
+  /// structural hash of head, tail and properties, equal for identical
+  /// expressions. Computed once and kept until the expression is modified.
+  std::uint64_t hash() const noexcept;
+
+  /// structural hash of a property map, as mixed into hash()
+  static std::uint64_t hash(const PropertyMap & properties) noexcept;
+
+  /// exact structural comparison, numbers must match bit for bit
+  bool identical(const Expression & exp) const noexcept;
 
   /// convienience member to determine if head atom is a number
   bool isHeadNumber() const noexcept;
@@ -85,21 +161,24 @@ public:
   /// convenience member to determine f head atom is a string
   bool isHeadString() const noexcept;
 
+  /// convenience member to determine if head atom is a future
+  bool isHeadFuture() const noexcept;
+
   /// Evaluate expression using a post-order traversal (recursive)
   Expression eval(Environment & env);
 
   /// equality comparison for two expressions (recursive)
-  bool operator==(const Expression & exp) const noexcept;
+  bool operator==(const Expression & exp) const;
 
-  std::string transferString() const noexcept;
+  std::string transferString() const;
   
-  bool isPoint() const noexcept;
-  bool isLine() const noexcept;
-  bool isText() const noexcept;
+  bool isPoint() const;
+  bool isLine() const;
+  bool isText() const;
 
   double pointTail0() const noexcept;
   double pointTail1() const noexcept;
-  Expression req() const noexcept;
+  Expression req() const;
   Expression textReq() const noexcept;
   double textRotReq() const noexcept;
   double lineTail0x() const noexcept;
@@ -107,7 +186,7 @@ public:
   double lineTail1x() const noexcept;
   double lineTail1y() const noexcept;
 
-  std::vector<Expression> getTail() const noexcept;
+  std::vector<Expression> getTail() const;
 
 private:
 
@@ -115,16 +194,51 @@ private:
   Atom m_head;
 
   // the tail list is expressed as a vector for access efficiency
-  // and cache coherence, at the cost of wasted memory.
-  std::vector<Expression> m_tail;
+  // and cache coherence, at the cost of wasted memory. It is filled in
+  // from m_seq the first time a lazy tail is iterated.
+  mutable std::vector<Expression> m_tail;
+
+  // the generator of a lazy tail, empty once materialized
+  mutable std::shared_ptr<const Sequence> m_seq;
+
+  // the property map, null when there are no properties. Maps are never
+  // modified once shared, set-property makes a new one.
+  std::shared_ptr<const PropertyMap> propmap;
+
+  // the cached hash, zero until computed
+  mutable std::atomic<std::uint64_t> m_hash;
 
-  // the property map
-  std::map<std::string, Expression> propmap;
+  // the value of property key, or a None expression
+  const Expression & property(const std::string & key) const noexcept;
+
+  // the classification of a lambda, worked out once when it is made
+  Purity m_purity;
+
+  // the symbols a lambda reads, worked out with its classification, null
+  // when there are none
+  std::shared_ptr<const std::vector<std::string>> m_reads;
+
+  // set on lambdas returned by the memoize special-form
+  bool m_memoized;
+
+  // the cached estimatedCost, zero until computed. Fits beside m_memoized
+  // without growing the expression.
+  mutable std::atomic<std::uint16_t> m_cost;
+
+  // the task behind a future, shared by copies of the future
+  std::shared_ptr<Future> m_future;
 
   // convenience typedef
   typedef std::vector<Expression>::iterator IteratorType;
   typedef std::vector<Expression>::iterator ListType;
   
+  // produce a lazy tail into m_tail, leaving an ordinary list. Throws,
+  // leaving the list lazy, when over the memory limit or cancelled.
+  void materialize() const;
+
+  // work out m_reads from the parameters and body of a lambda
+  void cache_reads();
+
   // internal helper methods
   Expression handle_lookup(const Atom & head, const Environment & env);
   Expression handle_define(Environment & env);
@@ -132,9 +246,21 @@ private:
   Expression handle_lambda(Environment & env);
   Expression handle_apply(Environment & env);
   Expression handle_map(Environment & env);
+  Expression handle_pmap(Environment & env);
+  Expression handle_memoize(Environment & env);
+  Expression handle_spawn(Environment & env);
+  Expression handle_await(Environment & env);
+  Expression handle_filter(Environment & env);
+  Expression handle_foldl(Environment & env);
+  Expression handle_foldr(Environment & env);
+  Expression handle_reduce(Environment & env);
+  Expression & fused_source(std::vector<PipelineStage> & stages, const Environment & env);
   Expression handle_set(Environment & env);
   Expression handle_get(Environment & env);
   Expression handle_discrete(Environment & env);
+  Expression handle_for(Environment & env);
+  Expression handle_do(Environment & env);
+  Expression handle_fold_range(Environment & env);
 
 };
 
@@ -142,6 +268,6 @@ private:
 std::ostream & operator<<(std::ostream & out, const Expression & exp);
 
 /// inequality comparison for two expressions (recursive)
-bool operator!=(const Expression & left, const Expression & right) noexcept;
+bool operator!=(const Expression & left, const Expression & right);
   
 #endif
@@ -25,4 +25,21 @@ TEST_CASE( "Test symbol expression", "[expression]" ) {
 
   REQUIRE(!exp.isHeadNumber());
   REQUIRE(exp.isHeadSymbol());
-}
\ No newline at end of file
+}
+
+TEST_CASE( "Test moving an expression", "[expression]" ) {
+
+  std::vector<Expression> tail = { Expression(1.), Expression(2.) };
+  Expression list(tail);
+  std::uint64_t hash = list.hash();
+
+  Expression moved(std::move(list));
+  REQUIRE(moved == Expression(tail));
+  REQUIRE(moved.hash() == hash);
+  REQUIRE(list.tailSize() == 0);
+
+  Expression assigned;
+  assigned = std::move(moved);
+  REQUIRE(assigned == Expression(tail));
+  REQUIRE(assigned.isHeadList());
+}
@@ -0,0 +1,97 @@
+/*
+Allocation-count benchmark for fused map/filter/foldl pipelines.
+
+Each case is run twice, once as a nested chain that the interpreter fuses
+into one loop and once with every intermediate list passed through
+(apply list ...), which the fusion does not look through, so that it has to
+be built. The program fails if fusion does not reduce both the number of heap
+allocations and the bytes allocated.
+
+usage: fusion_bench [N]
+*/
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+
+// operator new may be entered from any thread the interpreter uses
+static std::atomic<std::size_t> allocations(0);
+static std::atomic<std::size_t> allocated_bytes(0);
+
+void * operator new(std::size_t size) {
+	++allocations;
+	allocated_bytes += size;
+	void * p = std::malloc(size ? size : 1);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void * p) noexcept {
+	std::free(p);
+}
+
+struct Measurement {
+	std::size_t allocations;
+	std::size_t bytes;
+	double seconds;
+};
+
+static Measurement measure(const std::string & program) {
+	Interpreter interp;
+	std::istringstream iss(program);
+	if (!interp.parseStream(iss)) {
+		std::cerr << "Could not parse: " << program << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+	std::size_t before = allocations;
+	std::size_t before_bytes = allocated_bytes;
+	auto start = std::chrono::steady_clock::now();
+	interp.evaluate();
+	auto stop = std::chrono::steady_clock::now();
+	Measurement m = { allocations - before, allocated_bytes - before_bytes,
+		std::chrono::duration<double>(stop - start).count() };
+	return m;
+}
+
+int main(int argc, char *argv[]) {
+	std::string n = (argc > 1) ? argv[1] : "10000";
+	std::string defs = "(define f (lambda (x) (+ x 1))) (define g (lambda (x) (* x 2))) (define p (lambda (x) (- x 10))) ";
+	std::string source = "(range 0 " + n + " 1)";
+
+	struct Case {
+		std::string name;
+		std::string fused;
+		std::string unfused;
+	} cases[] = {
+		{ "map . map",
+		  "(begin " + defs + "(map f (map g " + source + ")))",
+		  "(begin " + defs + "(map f (apply list (map g " + source + "))))" },
+		{ "map . filter . map",
+		  "(begin " + defs + "(map f (filter p (map g " + source + "))))",
+		  "(begin " + defs + "(map f (apply list (filter p (apply list (map g " + source + "))))))" },
+		{ "foldl . map . map",
+		  "(begin " + defs + "(foldl + 0 (map f (map g " + source + "))))",
+		  "(begin " + defs + "(foldl + 0 (apply list (map f (apply list (map g " + source + "))))))" },
+	};
+
+	bool ok = true;
+	std::cout << "N = " << n << std::endl;
+	for (auto & c : cases) {
+		Measurement fused = measure(c.fused);
+		Measurement unfused = measure(c.unfused);
+		std::cout << c.name << ":" << std::endl
+			<< "  fused   " << fused.allocations << " allocations, " << fused.bytes << " bytes, " << fused.seconds << " s" << std::endl
+			<< "  unfused " << unfused.allocations << " allocations, " << unfused.bytes << " bytes, " << unfused.seconds << " s" << std::endl;
+		ok = ok && (fused.allocations < unfused.allocations) && (fused.bytes < unfused.bytes);
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,71 @@
+#include "future.hpp"
+
+#include <chrono>
+
+#include "semantic_error.hpp"
+#include "thread_pool.hpp"
+#include "cancel.hpp"
+#include "process_map.hpp"
+
+Future::Future(): worker(in_map_worker()), task_token(CancelToken::current().child()), done(false) {}
+
+Future::~Future() {
+
+  task_token.cancel();
+}
+
+CancelToken Future::token() const {
+
+  return task_token;
+}
+
+void Future::set_value(const Expression & result) {
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    value = result;
+    done = true;
+  }
+  finished.notify_all();
+}
+
+void Future::set_error(std::exception_ptr exception) {
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    error = exception;
+    done = true;
+  }
+  finished.notify_all();
+}
+
+bool Future::ready() const {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return done;
+}
+
+Expression Future::get() {
+
+  // a future of the parent may be finished by a thread the worker lacks
+  if (in_map_worker() && !worker) {
+    throw MapWorkerFallback();
+  }
+  while (!ready()) {
+    if (cancellation_requested()) {
+      throw SemanticError("Error: interpreter kernel interrupted");
+    }
+    // the task may still be queued behind us
+    if (ThreadPool::shared().run_one(this)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait_for(lock, std::chrono::milliseconds(1), [this]() { return done; });
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return value;
+}
@@ -0,0 +1,72 @@
+/*! \file future.hpp
+Defines the shared state behind the future values made by spawn.
+ */
+#ifndef FUTURE_HPP
+#define FUTURE_HPP
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+
+#include "expression.hpp"
+#include "cancel.hpp"
+
+/*! \class Future
+\brief The result of an expression evaluated on the thread pool.
+
+A spawned task sets either a value or an error exactly once. It is submitted
+to the pool with the future as its owner, and a waiting thread runs it
+itself if it is still queued, so awaiting inside another task cannot
+deadlock a pool with few workers. A worker process of a map can only await
+futures it made itself, the lock of any other may be held for good.
+
+The task runs under a token of its own, a child of the token current when
+the future was made. It is cancelled with the request that spawned it, or
+once the future is no longer referenced, but not when that request ends.
+ */
+class Future {
+public:
+
+  /// Construct a future that is not ready
+  Future();
+
+  /// cancel the task if it is still running
+  ~Future();
+
+  Future(const Future &) = delete;
+  Future & operator=(const Future &) = delete;
+
+  /// the token the task runs under
+  CancelToken token() const;
+
+  /// finish with a value
+  void set_value(const Expression & value);
+
+  /// finish with the exception thrown by the task
+  void set_error(std::exception_ptr error);
+
+  /// true once a value or error was set
+  bool ready() const;
+
+  /*! Wait for the task and return its value
+    \throws the exception thrown by the task, SemanticError when the
+    evaluation waiting is cancelled, or MapWorkerFallback when awaited in a
+    map worker process that did not make it
+   */
+  Expression get();
+
+private:
+
+  // made in a map worker process, see in_map_worker
+  const bool worker;
+
+  CancelToken task_token;
+
+  mutable std::mutex mutex;
+  std::condition_variable finished;
+  bool done;
+  Expression value;
+  std::exception_ptr error;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include "interner.hpp"
+
+#include <algorithm>
+
+// true if both maps hold identical keys and values
+static bool identical(const Expression::PropertyMap & left, const Expression::PropertyMap & right) {
+
+  if (left.size() != right.size()) {
+    return false;
+  }
+  for (auto l = left.begin(), r = right.begin(); l != left.end(); ++l, ++r) {
+    if (l->first != r->first || !l->second.identical(r->second)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+PropertyInterner::PropertyPtr PropertyInterner::intern(const PropertyPtr & properties) {
+
+  if (!properties) {
+    return properties;
+  }
+  std::uint64_t key = Expression::hash(*properties);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto & bucket = table[key];
+  bucket.erase(std::remove_if(bucket.begin(), bucket.end(),
+    [](const std::weak_ptr<const Expression::PropertyMap> & p) { return p.expired(); }), bucket.end());
+
+  for (auto & weak : bucket) {
+    PropertyPtr shared = weak.lock();
+    if (shared && identical(*shared, *properties)) {
+      return shared;
+    }
+  }
+  bucket.push_back(properties);
+  return properties;
+}
+
+std::size_t PropertyInterner::size() const {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::size_t count = 0;
+  for (auto & bucket : table) {
+    for (auto & weak : bucket.second) {
+      count += weak.expired() ? 0 : 1;
+    }
+  }
+  return count;
+}
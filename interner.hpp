@@ -0,0 +1,44 @@
+/*! \file interner.hpp
+Defines the table used to share identical property maps between expressions.
+ */
+#ifndef INTERNER_HPP
+#define INTERNER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "expression.hpp"
+
+/*! \class PropertyInterner
+\brief Hash-consing of the property maps set by set-property.
+
+intern returns a map already in the table when an identical one is live, so
+plots building many objects with the same style hold one copy of the style.
+The table only keeps weak references; maps no expression uses are dropped
+the next time their bucket is visited. All members may be called concurrently.
+ */
+class PropertyInterner {
+public:
+
+  typedef std::shared_ptr<const Expression::PropertyMap> PropertyPtr;
+
+  PropertyInterner() = default;
+  PropertyInterner(const PropertyInterner &) = delete;
+  PropertyInterner & operator=(const PropertyInterner &) = delete;
+
+  /// the shared map identical to properties, adding properties if there is none
+  PropertyPtr intern(const PropertyPtr & properties);
+
+  /// the number of live maps in the table
+  std::size_t size() const;
+
+private:
+
+  mutable std::mutex mutex;
+  std::unordered_map<std::uint64_t, std::vector<std::weak_ptr<const Expression::PropertyMap>>> table;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "catch.hpp"
+
+#include <string>
+#include <sstream>
+#include <fstream>
+
+#include "interpreter.hpp"
+#include "expression.hpp"
+#include "interner.hpp"
+#include "startup_config.hpp"
+
+// a property map holding the given object name
+static PropertyInterner::PropertyPtr properties(const std::string & name) {
+	std::shared_ptr<Expression::PropertyMap> map = std::make_shared<Expression::PropertyMap>();
+	(*map)["\"object-name\""] = Expression(Atom("\"" + name + "\""));
+	(*map)["\"size\""] = Expression(0.);
+	return map;
+}
+
+TEST_CASE("Test identical property maps are interned once", "[interner]") {
+	PropertyInterner interner;
+	PropertyInterner::PropertyPtr first = interner.intern(properties("point"));
+	PropertyInterner::PropertyPtr second = interner.intern(properties("point"));
+	PropertyInterner::PropertyPtr other = interner.intern(properties("line"));
+
+	REQUIRE(first == second);
+	REQUIRE(first != other);
+	REQUIRE(interner.size() == 2);
+
+	// maps nothing refers to any more are not kept alive
+	other.reset();
+	REQUIRE(interner.size() == 1);
+	REQUIRE(interner.intern(nullptr) == nullptr);
+}
+
+TEST_CASE("Test cached hash follows changes to the expression", "[interner]") {
+	Expression exp(Atom("+"));
+	exp.append(Atom(1.));
+	std::uint64_t before = exp.hash();
+	REQUIRE(exp.hash() == before);
+
+	exp.append(Atom(2.));
+	REQUIRE(exp.hash() != before);
+
+	Expression copy(exp);
+	REQUIRE(copy.hash() == exp.hash());
+	copy.head() = Atom("-");
+	REQUIRE(copy.hash() != exp.hash());
+	REQUIRE_FALSE(copy.identical(exp));
+}
+
+TEST_CASE("Test hash-consing keeps plot objects equal", "[interner]") {
+	for (bool consing : { false, true }) {
+		INFO(consing);
+		Interpreter interp;
+		interp.setHashConsing(consing);
+		std::ifstream ifs(STARTUP_FILE);
+		REQUIRE(interp.parseStream(ifs));
+		interp.evaluate();
+
+		std::istringstream iss("(list (make-point 1 2) (make-point 1 2) (set-property \"size\" 3 (make-point 1 2)))");
+		REQUIRE(interp.parseStream(iss));
+		Expression result = interp.evaluate();
+		std::vector<Expression> points = result.getTail();
+
+		REQUIRE(points[0].isPoint());
+		REQUIRE(points[0].identical(points[1]));
+		REQUIRE(points[0].hash() == points[1].hash());
+		REQUIRE_FALSE(points[0].identical(points[2]));
+		REQUIRE(points[2].req() == Expression(3.));
+	}
+}
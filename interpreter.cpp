@@ -9,6 +9,17 @@
 #include "expression.hpp"
 #include "environment.hpp"
 #include "semantic_error.hpp"
+#include "runtime.hpp"
+
+Interpreter::Interpreter(const Snapshot & snapshot){
+
+  restore_snapshot(snapshot, env);
+}
+
+void Interpreter::writeSnapshot(std::ostream & out, const std::string & name) const{
+
+  write_snapshot(out, env, name);
+}
 
 bool Interpreter::parseStream(std::istream & expression) noexcept{
 
@@ -20,7 +31,82 @@ bool Interpreter::parseStream(std::istream & expression) noexcept{
 };
 				     
 
+// run the AST under a fresh budget when any limit is set
+static Expression evaluate_limited(Expression & ast, Environment & env){
+
+  Limits limits = env.runtime().limits();
+  if(!limits.steps && !limits.milliseconds && !limits.bytes){
+    return ast.eval(env);
+  }
+  BudgetScope scope(std::make_shared<Budget>(limits));
+  Expression result = ast.eval(env);
+  // a charge by the last step is only noticed at the next one
+  current_budget->check();
+  return result;
+}
+
 Expression Interpreter::evaluate(){
 
-  return ast.eval(env);
+  return evaluate_limited(ast, env);
+}
+
+Expression Interpreter::evaluate(const CancelToken & token){
+
+  CancelScope scope(token);
+  return evaluate_limited(ast, env);
+}
+
+Interpreter Interpreter::clone() const{
+
+  Interpreter copy;
+  copy.env = env.isolated();
+  copy.ast = ast;
+  return copy;
+}
+
+void Interpreter::restore(const Interpreter & checkpoint){
+
+  env = checkpoint.env;
+  // results of lambdas reading the globals that were replaced are stale
+  env.runtime().memo().clear();
+}
+
+void Interpreter::setMemoCapacity(std::size_t bytes){
+
+  env.runtime().memo().setCapacity(bytes);
+}
+
+void Interpreter::setAutoMemoize(bool on){
+
+  env.runtime().setAutoMemoize(on);
+}
+
+MemoStats Interpreter::memoStats() const{
+
+  return env.runtime().memo().stats();
+}
+
+void Interpreter::setHashConsing(bool on){
+
+  env.runtime().setHashConsing(on);
+}
+
+void Interpreter::setParallelArguments(bool on){
+
+  env.runtime().setParallelArguments(on);
+}
+
+void Interpreter::setProcessParallel(bool on){
+
+  env.runtime().setProcessParallel(on);
+}
+
+void Interpreter::setLimits(const Limits & limits){
+
+  env.runtime().setLimits(limits);
+}
+
+Limits Interpreter::limits() const{
+
+  return env.runtime().limits();
 }
@@ -9,12 +9,16 @@ It maintains an environment during evaluation.
 
 // system includes
 #include <istream>
+#include <ostream>
 #include <string>
 
 // module includes
 #include "environment.hpp"
 #include "expression.hpp"
 #include "message_queue.hpp"
+#include "cancel.hpp"
+#include "budget.hpp"
+#include "snapshot.hpp"
 
 /*! \class Interpreter
 \brief Class to parse and evaluate an expression (program)
@@ -26,6 +30,22 @@ The eval method updates Environment and returns last result.
 class Interpreter {
 public:
 
+  /// Construct with the default environment
+  Interpreter() = default;
+
+  /*! Construct with the default environment and the definitions of a
+    snapshot, as if the program it was saved from had been evaluated.
+    \param snapshot the definitions, usually startup_snapshot
+   */
+  explicit Interpreter(const Snapshot & snapshot);
+
+  /*! Write C++ source defining a Snapshot of the definitions made so far.
+    \param out where to write the source
+    \param name the name of the Snapshot variable
+    \throws SemanticError if a definition cannot be saved
+   */
+  void writeSnapshot(std::ostream & out, const std::string & name) const;
+
   /*! Parse into an internal Expression from a stream
     \param expression the raw text stream repreenting the candidate expression
     \return true on successful parsing 
@@ -33,11 +53,61 @@ public:
   bool parseStream(std::istream &expression) noexcept;
 
   /*! Evaluate the Expression by walking the tree, returning the result.
+    Tasks spawned by the evaluation run on after it returns, until their
+    futures are no longer referenced.
     \return the Expression resulting from the evaluation in the current environment
     \throws SemanticError when a semantic error is encountered
    */
   Expression evaluate();
 
+  /*! Evaluate under a cancellation token, stopping once it is cancelled.
+    \param token the token of this request, shared with whoever may cancel it
+    \return the Expression resulting from the evaluation in the current environment
+    \throws SemanticError when a semantic error is encountered or the
+    token is cancelled, even before the evaluation started
+   */
+  Expression evaluate(const CancelToken & token);
+
+  /*! A copy with the same definitions and settings, but with a memo cache
+    and property table of its own. Plain copies share those with the
+    interpreter they were copied from, so a clone is what to hand to
+    another request or file.
+   */
+  Interpreter clone() const;
+
+  /*! Go back to the definitions of checkpoint, a copy of an interpreter
+    made earlier. Copies share their definitions until one changes, so
+    taking a checkpoint and restoring it take constant time.
+    \param checkpoint the interpreter to take the definitions of
+   */
+  void restore(const Interpreter & checkpoint);
+
+  /// limit the memory held by memoized results, zero disables caching
+  void setMemoCapacity(std::size_t bytes);
+
+  /// memoize every call to a pure lambda, not only those wrapped with memoize
+  void setAutoMemoize(bool on);
+
+  /// the counters of the memo cache
+  MemoStats memoStats() const;
+
+  /// share identical property maps made by set-property between expressions
+  void setHashConsing(bool on);
+
+  /// evaluate expensive, side-effect free procedure arguments in parallel
+  void setParallelArguments(bool on);
+
+  /// run pmap and parallel map chunks in forked processes where supported,
+  /// falling back to threads for non-numeric results
+  void setProcessParallel(bool on);
+
+  /// bound the steps, time and memory of each evaluate, zero fields are
+  /// unlimited; exceeding a limit throws LimitError
+  void setLimits(const Limits & limits);
+
+  /// the limits each evaluate runs under
+  Limits limits() const;
+
 private:
 
   // the environment
@@ -4,11 +4,18 @@
 #include <sstream>
 #include <fstream>
 #include <iostream>
+#include <chrono>
+#include <thread>
 
 #include "semantic_error.hpp"
 #include "interpreter.hpp"
 #include "expression.hpp"
 #include "startup_config.hpp"
+#include "environment.hpp"
+#include "token.hpp"
+#include "parse.hpp"
+#include "future.hpp"
+#include "cancel.hpp"
 
 
 Expression run(const std::string & program){
@@ -911,3 +918,450 @@ TEST_CASE("Test Discrete", "[interpreter]") {
 	REQUIRE(result.getTail().size() == 32);
 	REQUIRE(!result.head().isDiscrete());
 }
+
+TEST_CASE("Test for loop", "[interpreter]") {
+	std::string program = "(for (i 1 10 1) (* i i))";
+	INFO(program);
+	Expression result = run(program);
+	REQUIRE(result == Expression(100.));
+}
+
+TEST_CASE("Test do loop accumulates", "[interpreter]") {
+	std::string program = "(do (acc 0) (i 1 100 1) (+ acc i))";
+	INFO(program);
+	Expression result = run(program);
+	REQUIRE(result == Expression(5050.));
+}
+
+TEST_CASE("Test fold-range with procedure and lambda", "[interpreter]") {
+	{
+		std::string program = "(fold-range + 0 1 100 1)";
+		INFO(program);
+		Expression result = run(program);
+		REQUIRE(result == Expression(5050.));
+	}
+	{
+		std::string program = "(begin (define f (lambda (acc x) (+ acc (* 2 x)))) (fold-range f 1 0 1 0.5))";
+		INFO(program);
+		Expression result = run(program);
+		REQUIRE(result == Expression(4.));
+	}
+}
+
+TEST_CASE("Test loop forms do not leak the counter", "[interpreter]") {
+	std::string program = "(begin (define i 7) (for (i 0 3 1) (i)) (i))";
+	INFO(program);
+	Expression result = run(program);
+	REQUIRE(result == Expression(7.));
+}
+
+TEST_CASE("Test loop forms step the counter by index", "[interpreter]") {
+	// 0.1 does not add up to exactly 1, the counter must not drift
+	REQUIRE(run("(for (i 0 1 0.1) i)").head().asNumber() == 1.);
+	REQUIRE(run("(for (i 0.1 2.5 0.3) i)").head().asNumber() == 2.5);
+	REQUIRE(run("(do (n 0) (i 0 1 0.1) (+ n 1))") == Expression(11.));
+	REQUIRE(run("(do (n 0) (i 0 0.3 0.1) (+ n 1))") == Expression(3.));
+	REQUIRE(run("(fold-range + 0 0 1 0.1)") == run("(do (n 0) (i 0 1 0.1) (+ n i))"));
+}
+
+TEST_CASE("Test loop form errors", "[interpreter]") {
+	std::vector<std::string> programs = { "(for (i 0 10 0) (i))",
+					      "(for (i 10 0 1) (i))",
+					      "(for (+ 0 10 1) (i))",
+					      "(for (i 0 10) (i))",
+					      "(do (acc 0) (acc 0 10 1) (acc))",
+					      "(fold-range 3 0 0 10 1)",
+					      "(fold-range + 0 0 \"a\" 1)",
+					      "(for (i 0 1e30 1) i)",
+					      "(fold-range + 0 0 (/ 1 0) 1)" };
+	for (auto s : programs) {
+		INFO(s);
+		Interpreter interp;
+		std::istringstream iss(s);
+		REQUIRE(interp.parseStream(iss));
+		REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+	}
+}
+
+TEST_CASE("Test range is lazy", "[interpreter]") {
+	{
+		std::string program = "(range 0 1000000000 1)";
+		INFO(program);
+		Expression result = run(program);
+		REQUIRE(result.isLazy());
+		REQUIRE(result.tailSize() == 1000000001);
+	}
+	{
+		std::string program = "(first (rest (rest (range 0 1000000000 1))))";
+		INFO(program);
+		Expression result = run(program);
+		REQUIRE(result == Expression(2.));
+	}
+	{
+		std::string program = "(length (rest (range 0 1000000000 1)))";
+		INFO(program);
+		Expression result = run(program);
+		REQUIRE(result == Expression(1000000000.));
+	}
+}
+
+TEST_CASE("Test map and join over a lazy range", "[interpreter]") {
+	{
+		std::string program = "(begin (define f (lambda (x) (* x x))) (map f (range 1 3 1)))";
+		INFO(program);
+		Expression result = run(program);
+		std::vector<Expression> expected = { Expression(1.), Expression(4.), Expression(9.) };
+		REQUIRE(result == Expression(expected));
+	}
+	{
+		std::string program = "(join (range 1 2 1) (list 3))";
+		INFO(program);
+		Expression result = run(program);
+		std::vector<Expression> expected = { Expression(1.), Expression(2.), Expression(3.) };
+		REQUIRE(result == Expression(expected));
+	}
+}
+
+TEST_CASE("Test filter and foldl", "[interpreter]") {
+	{
+		std::string program = "(begin (define not3 (lambda (x) (- x 3))) (filter not3 (list 1 2 3 4)))";
+		INFO(program);
+		Expression result = run(program);
+		std::vector<Expression> expected = { Expression(1.), Expression(2.), Expression(4.) };
+		REQUIRE(result == Expression(expected));
+	}
+	{
+		std::string program = "(foldl + 10 (list 1 2 3))";
+		INFO(program);
+		Expression result = run(program);
+		REQUIRE(result == Expression(16.));
+	}
+	{
+		std::string program = "(begin (define f (lambda (acc x) (list acc x))) (foldl f 0 (list 1 2)))";
+		INFO(program);
+		Expression result = run(program);
+		std::vector<Expression> inner = { Expression(0.), Expression(1.) };
+		std::vector<Expression> expected = { Expression(inner), Expression(2.) };
+		REQUIRE(result == Expression(expected));
+	}
+}
+
+TEST_CASE("Test fused map, filter and foldl chains", "[interpreter]") {
+	{
+		std::string program = "(begin (define sq (lambda (x) (* x x))) (define inc (lambda (x) (+ x 1))) (map inc (map sq (range 1 3 1))))";
+		INFO(program);
+		Expression result = run(program);
+		std::vector<Expression> expected = { Expression(2.), Expression(5.), Expression(10.) };
+		REQUIRE(result == Expression(expected));
+	}
+	{
+		std::string program = "(begin (define big (lambda (x) (- x 2))) (define sq (lambda (x) (* x x))) (foldl + 0 (map sq (filter big (list 1 2 3 4)))))";
+		INFO(program);
+		Expression result = run(program);
+		REQUIRE(result == Expression(26.));
+	}
+	{
+		// a malformed inner link is not fused and reports its own error
+		std::string program = "(map - (map 3 (list 1 2)))";
+		INFO(program);
+		Interpreter interp;
+		std::istringstream iss(program);
+		REQUIRE(interp.parseStream(iss));
+		REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+	}
+}
+
+TEST_CASE("Test filter and foldl errors", "[interpreter]") {
+	std::vector<std::string> programs = { "(filter + 3)",
+					      "(filter 3 (list 1 2))",
+					      "(filter list (list 1 2))",
+					      "(foldl + 0)",
+					      "(foldl + 0 5)" };
+	for (auto s : programs) {
+		INFO(s);
+		Interpreter interp;
+		std::istringstream iss(s);
+		REQUIRE(interp.parseStream(iss));
+		REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+	}
+}
+
+TEST_CASE("Test foldr and reduce", "[interpreter]") {
+	{
+		std::string program = "(begin (define f (lambda (x acc) (list x acc))) (foldr f 0 (list 1 2)))";
+		INFO(program);
+		Expression result = run(program);
+		std::vector<Expression> inner = { Expression(2.), Expression(0.) };
+		std::vector<Expression> expected = { Expression(1.), Expression(inner) };
+		REQUIRE(result == Expression(expected));
+	}
+	{
+		std::string program = "(reduce - (list 10 1 2))";
+		INFO(program);
+		Expression result = run(program);
+		REQUIRE(result == Expression(7.));
+	}
+	{
+		std::string program = "(begin (define sq (lambda (x) (* x x))) (reduce + (map sq (range 1 3 1))))";
+		INFO(program);
+		Expression result = run(program);
+		REQUIRE(result == Expression(14.));
+	}
+	{
+		std::string program = "(reduce + (list))";
+		INFO(program);
+		Interpreter interp;
+		std::istringstream iss(program);
+		REQUIRE(interp.parseStream(iss));
+		REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+	}
+}
+
+TEST_CASE("Test reused call frames keep lambda bodies independent", "[interpreter]") {
+	std::string program = "(begin (define a 1) (define f (lambda (x) (begin (define b (* 2 x)) (+ a b)))) (list (map f (list 1 2 3)) (a)))";
+	INFO(program);
+	Expression result = run(program);
+	std::vector<Expression> mapped = { Expression(3.), Expression(5.), Expression(7.) };
+	std::vector<Expression> expected = { Expression(mapped), Expression(1.) };
+	REQUIRE(result == Expression(expected));
+}
+
+TEST_CASE("Test a define in a lambda body does not reach the next call", "[interpreter]") {
+	{
+		std::string program = "(begin (define a 0) (define f (lambda (x) (begin (define a (+ a x)) (list a)))) (map f (list 1 2 3)))";
+		INFO(program);
+		Expression result = run(program);
+		std::vector<Expression> one = { Expression(1.) }, two = { Expression(2.) }, three = { Expression(3.) };
+		std::vector<Expression> expected = { Expression(one), Expression(two), Expression(three) };
+		REQUIRE(result == Expression(expected));
+	}
+	{
+		std::string program = "(begin (define a 0) (define f (lambda (acc x) (begin (define a (+ a x)) (+ acc a)))) (foldl f 0 (list 1 2 3)))";
+		INFO(program);
+		REQUIRE(run(program) == Expression(6.));
+	}
+}
+
+TEST_CASE("Test pmap keeps order and matches map", "[interpreter]") {
+	{
+		std::string program = "(begin (define sq (lambda (x) (* x x))) (pmap sq (range 1 200 1)))";
+		INFO(program);
+		Expression result = run(program);
+		std::vector<Expression> expected;
+		for (int i = 1; i <= 200; i++) {
+			expected.push_back(Expression(double(i * i)));
+		}
+		REQUIRE(result == Expression(expected));
+	}
+	{
+		std::string program = "(begin (define inc (lambda (x) (+ x 1))) (define not3 (lambda (x) (- x 3))) (pmap inc (filter not3 (list 1 2 3 4 5))))";
+		INFO(program);
+		Expression result = run(program);
+		std::vector<Expression> expected = { Expression(2.), Expression(3.), Expression(5.), Expression(6.) };
+		REQUIRE(result == Expression(expected));
+	}
+	{
+		std::string program = "(pmap - (list))";
+		INFO(program);
+		Expression result = run(program);
+		REQUIRE(result == Expression(std::vector<Expression>()));
+	}
+}
+
+TEST_CASE("Test pmap errors", "[interpreter]") {
+	std::vector<std::string> programs = { "(pmap + 1)",
+		"(pmap (list 1 2))",
+		"(begin (define f (lambda (x) (first x))) (pmap f (range 1 100 1)))",
+		"(begin (define f (lambda (x) (+ x \"a\"))) (pmap f (range 1 100 1)))" };
+	for (auto s : programs) {
+		INFO(s);
+		Interpreter interp;
+		std::istringstream iss(s);
+		REQUIRE(interp.parseStream(iss));
+		REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+	}
+}
+
+TEST_CASE("Test long maps over pure lambdas match the sequential result", "[interpreter]") {
+	std::string program = "(begin (define a 3) (define f (lambda (x) (* a x))) (foldl + 0 (map f (range 1 5000 1))))";
+	INFO(program);
+	Expression result = run(program);
+	REQUIRE(result == Expression(3. * 5000 * 5001 / 2));
+
+	std::string ordered = "(begin (define f (lambda (x) (- x))) (last (map f (range 1 5000 1))))";
+	INFO(ordered);
+	REQUIRE(run(ordered) == Expression(-5000.));
+}
+
+TEST_CASE("Test parallel argument evaluation matches sequential", "[interpreter]") {
+	std::vector<std::string> programs = {
+		"(begin (define f (lambda (x) (* x x))) (define g (lambda (x) (+ x 1))) (join (map f (range 1 3000 1)) (map g (range 1 3000 1))))",
+		"(begin (define f (lambda (x) (* x 2))) (+ (foldl + 0 (map f (range 1 5000 1))) (foldl + 0 (map f (range 1 5000 1))) 1))",
+		// a side-effecting argument keeps every argument on this thread, in order
+		"(begin (define f (lambda (x) (* x 2))) (list (begin (define a 3) (length (map f (range 1 5000 1)))) (map f (range 1 5000 a))))" };
+	for (auto s : programs) {
+		INFO(s);
+		Expression expected = run(s);
+
+		Interpreter interp;
+		interp.setParallelArguments(true);
+		std::istringstream iss(s);
+		REQUIRE(interp.parseStream(iss));
+		REQUIRE(interp.evaluate() == expected);
+	}
+}
+
+TEST_CASE("Test parallel argument errors", "[interpreter]") {
+	std::string program = "(begin (define f (lambda (x) (first x))) (define g (lambda (x) x)) (join (map g (range 1 5000 1)) (map f (range 1 5000 1))))";
+	INFO(program);
+	Interpreter interp;
+	interp.setParallelArguments(true);
+	std::istringstream iss(program);
+	REQUIRE(interp.parseStream(iss));
+	REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+}
+
+TEST_CASE("Test cancelling a call stops its parallel arguments", "[interpreter]") {
+	std::string program = "(begin (define f (lambda (a x) (+ a x))) (+ (foldl f 0 (range 0 1e9 1)) (foldl f 0 (range 0 1e9 1))))";
+	INFO(program);
+	Interpreter interp;
+	interp.setParallelArguments(true);
+	std::istringstream iss(program);
+	REQUIRE(interp.parseStream(iss));
+
+	CancelToken token;
+	std::thread canceller([token]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		token.cancel();
+	});
+	auto start = std::chrono::steady_clock::now();
+	REQUIRE_THROWS_AS(interp.evaluate(token), SemanticError);
+	canceller.join();
+	// the argument on the pool stops too, rather than being waited for
+	REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+}
+
+TEST_CASE("Test the cost of an argument is estimated once", "[interpreter]") {
+	Environment env;
+	auto read = [](const std::string & program) {
+		std::istringstream iss(program);
+		return parse(tokenize(iss));
+	};
+
+	Expression call = read("(map f (list 1 2 3))");
+	std::size_t cost = call.estimatedCost(env);
+	read("(define f (lambda (x) (foldl + 0 (range 0 100000 1))))").eval(env);
+	// kept with the expression and its copies
+	REQUIRE(call.estimatedCost(env) == cost);
+	REQUIRE(Expression(call).estimatedCost(env) == cost);
+	REQUIRE(read("(map f (list 1 2 3))").estimatedCost(env) > cost);
+
+	// an enormous range saturates the estimate
+	REQUIRE(read("(map f (range 0 1e300 1))").estimatedCost(env) == 0xffff);
+}
+
+TEST_CASE("Test spawn and await", "[interpreter]") {
+	{
+		std::string program = "(begin (define f (lambda (x) (* x x))) (define a (spawn (foldl + 0 (map f (range 1 100 1))))) (define b (spawn (length (range 1 50 1)))) (await (list a b)))";
+		INFO(program);
+		Expression result = run(program);
+		std::vector<Expression> expected = { Expression(338350.), Expression(50.) };
+		REQUIRE(result == Expression(expected));
+	}
+	{
+		// awaiting twice gives the same value
+		std::string program = "(begin (define a (spawn (+ 1 2))) (+ (await a) (await a)))";
+		INFO(program);
+		REQUIRE(run(program) == Expression(6.));
+	}
+	{
+		// the task sees the environment as it was when spawned
+		std::string program = "(begin (define x 1) (define a (spawn (begin (define x 5) x))) (list (await a) x))";
+		INFO(program);
+		std::vector<Expression> expected = { Expression(5.), Expression(1.) };
+		REQUIRE(run(program) == Expression(expected));
+	}
+	{
+		// nested spawns on a small pool
+		std::string program = "(await (spawn (await (spawn (await (spawn 7))))))";
+		INFO(program);
+		REQUIRE(run(program) == Expression(7.));
+	}
+	{
+		// a future prints as such, not as an empty list
+		std::ostringstream out;
+		out << run("(spawn 1)");
+		REQUIRE(out.str() == "(<future>)");
+	}
+}
+
+TEST_CASE("Test tasks spawned by a request outlive it", "[interpreter]") {
+	Interpreter interp;
+	auto eval = [&interp](const std::string & program, const CancelToken & token) {
+		std::istringstream iss(program);
+		REQUIRE(interp.parseStream(iss));
+		return interp.evaluate(token);
+	};
+
+	// awaited by a later request, as on the next line of the REPL
+	REQUIRE(eval("(define a (spawn (+ 1 2)))", CancelToken()).isHeadFuture());
+	REQUIRE(eval("(await a)", CancelToken()) == Expression(3.));
+
+	// cancelling the request that spawned a task cancels the task
+	CancelToken token;
+	REQUIRE(eval("(begin (define f (lambda (a x) (+ a x))) (define b (spawn (foldl f 0 (range 0 1e9 1)))))", token).isHeadFuture());
+	token.cancel();
+	auto start = std::chrono::steady_clock::now();
+	REQUIRE_THROWS_WITH(eval("(await b)", CancelToken()), "Error during evaluation: spawned task was cancelled");
+	REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+
+	// and so does dropping its future
+	CancelToken request;
+	CancelScope scope(request);
+	std::shared_ptr<Future> future = std::make_shared<Future>();
+	CancelToken task = future->token();
+	REQUIRE_FALSE(task.cancelled());
+	future.reset();
+	REQUIRE(task.cancelled());
+	REQUIRE_FALSE(request.cancelled());
+}
+
+TEST_CASE("Test spawn and await errors", "[interpreter]") {
+	std::vector<std::string> programs = { "(await (spawn (first 1)))",
+		"(await 1)",
+		"(await (list (spawn 1) 2))",
+		"(spawn)",
+		"(spawn 1 2)" };
+	for (auto s : programs) {
+		INFO(s);
+		Interpreter interp;
+		std::istringstream iss(s);
+		REQUIRE(interp.parseStream(iss));
+		REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+	}
+}
+
+TEST_CASE("Test checkpoints of an interpreter", "[interpreter]") {
+	Interpreter interp;
+	auto eval = [&interp](const std::string & program) {
+		std::istringstream iss(program);
+		REQUIRE(interp.parseStream(iss));
+		return interp.evaluate();
+	};
+
+	eval("(begin (define a 1) (define f (lambda (x) (+ x a))))");
+	Interpreter checkpoint = interp;
+
+	// later definitions do not reach the checkpoint
+	eval("(begin (define a 10) (define b 2))");
+	REQUIRE(eval("(f b)") == Expression(12.));
+
+	interp.restore(checkpoint);
+	REQUIRE(eval("(f 1)") == Expression(2.));
+	REQUIRE_THROWS_AS(eval("(+ b 0)"), SemanticError);
+
+	// and restoring does not tie the two together
+	eval("(define a 5)");
+	interp.restore(checkpoint);
+	REQUIRE(eval("(+ a 0)") == Expression(1.));
+}
@@ -0,0 +1,133 @@
+#include "memo.hpp"
+
+#include <string>
+
+// an estimate of the memory held by an expression, lazy tails hold only
+// their generator
+static std::size_t footprint(const Expression & exp) {
+
+  std::size_t size = sizeof(Expression);
+  if (exp.head().isSymbol()) {
+    size += exp.head().asSymbol().capacity();
+  }
+  else if (exp.head().isString()) {
+    size += exp.head().asString().capacity();
+  }
+  if (exp.isLazy()) {
+    return size;
+  }
+  for (auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); ++e) {
+    size += footprint(*e);
+  }
+  return size;
+}
+
+// true if every argument is the same down to the bits
+static bool identical(const std::vector<Expression> & left, const std::vector<Expression> & right) {
+
+  if (left.size() != right.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < left.size(); ++i) {
+    if (!left[i].identical(right[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+MemoCache::MemoCache(std::size_t capacity):
+  m_capacity(capacity), bytes(0), hits(0), misses(0), evictions(0) {}
+
+std::uint64_t MemoCache::key(const Expression & lambda, const std::vector<Expression> & args) noexcept {
+
+  std::uint64_t key = lambda.hash();
+  for (auto & arg : args) {
+    key = (key ^ arg.hash()) * 0x100000001b3ULL;
+  }
+  return key;
+}
+
+bool MemoCache::lookup(std::uint64_t key, const Expression & lambda, const std::vector<Expression> & args,
+  Expression & result) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto found = index.find(key);
+  // different calls may share a key
+  if (found == index.end() || !found->second->lambda.identical(lambda) || !identical(found->second->args, args)) {
+    ++misses;
+    return false;
+  }
+  // move to the front, it is now the most recently used
+  entries.splice(entries.begin(), entries, found->second);
+  result = found->second->result;
+  ++hits;
+  return true;
+}
+
+void MemoCache::insert(std::uint64_t key, const Expression & lambda, const std::vector<Expression> & args,
+  const Expression & result) {
+
+  std::size_t size = sizeof(Entry) + footprint(lambda) + footprint(result);
+  for (auto & arg : args) {
+    size += footprint(arg);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (size > m_capacity) {
+    return;
+  }
+
+  // a different call with the same key, or the same call finished on two
+  // threads, replaces the older entry
+  auto found = index.find(key);
+  if (found != index.end()) {
+    bytes -= found->second->bytes;
+    entries.erase(found->second);
+    index.erase(found);
+  }
+
+  Entry entry = { key, lambda, args, result, size };
+  entries.push_front(entry);
+  index[key] = entries.begin();
+  bytes += size;
+  trim();
+}
+
+void MemoCache::setCapacity(std::size_t capacity) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  m_capacity = capacity;
+  trim();
+}
+
+std::size_t MemoCache::capacity() const {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return m_capacity;
+}
+
+void MemoCache::clear() {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  index.clear();
+  bytes = 0;
+}
+
+MemoStats MemoCache::stats() const {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  MemoStats stats = { hits, misses, evictions, entries.size(), bytes };
+  return stats;
+}
+
+void MemoCache::trim() {
+
+  while (bytes > m_capacity && !entries.empty()) {
+    bytes -= entries.back().bytes;
+    index.erase(entries.back().key);
+    entries.pop_back();
+    ++evictions;
+  }
+}
@@ -0,0 +1,101 @@
+/*! \file memo.hpp
+Defines the cache of lambda results used to memoize calls.
+ */
+#ifndef MEMO_HPP
+#define MEMO_HPP
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "expression.hpp"
+
+/*! \struct MemoStats
+\brief Counters describing the use of a MemoCache.
+ */
+struct MemoStats {
+  /// calls answered from the cache
+  std::size_t hits;
+  /// calls that had to be evaluated
+  std::size_t misses;
+  /// entries dropped to stay under the capacity
+  std::size_t evictions;
+  /// entries currently held
+  std::size_t entries;
+  /// estimated memory held by the entries
+  std::size_t bytes;
+};
+
+/*! \class MemoCache
+\brief Results of lambda calls keyed on the lambda and its arguments.
+
+Keys combine the structural hash of the lambda with the hashes of the
+arguments; the lambda and arguments are kept with each entry and compared
+exactly on a hit. Callers add the values of the globals the lambda reads to
+the arguments, so a result is not reused once one of them is redefined.
+When the estimated size of the entries passes the capacity the least
+recently used entries are evicted. All members may be called concurrently.
+ */
+class MemoCache {
+public:
+
+  /// the capacity of a new cache, in bytes
+  static const std::size_t default_capacity = 16 * 1024 * 1024;
+
+  /// Construct an empty cache holding at most capacity bytes
+  explicit MemoCache(std::size_t capacity = default_capacity);
+
+  MemoCache(const MemoCache &) = delete;
+  MemoCache & operator=(const MemoCache &) = delete;
+
+  /// the key of a call to lambda
+  static std::uint64_t key(const Expression & lambda, const std::vector<Expression> & args) noexcept;
+
+  /// find the result cached for a call to lambda with args, counting a hit or a miss
+  bool lookup(std::uint64_t key, const Expression & lambda, const std::vector<Expression> & args, Expression & result);
+
+  /// cache the result of a call, evicting old entries as needed
+  void insert(std::uint64_t key, const Expression & lambda, const std::vector<Expression> & args,
+    const Expression & result);
+
+  /// change the capacity in bytes, zero disables caching
+  void setCapacity(std::size_t bytes);
+
+  /// the capacity in bytes
+  std::size_t capacity() const;
+
+  /// drop every entry, keeping the counters
+  void clear();
+
+  /// a snapshot of the counters
+  MemoStats stats() const;
+
+private:
+
+  struct Entry {
+    std::uint64_t key;
+    Expression lambda;
+    std::vector<Expression> args;
+    Expression result;
+    std::size_t bytes;
+  };
+
+  // evict from the back of the list until under the capacity, mutex held
+  void trim();
+
+  mutable std::mutex mutex;
+
+  // most recently used first
+  std::list<Entry> entries;
+  std::unordered_map<std::uint64_t, std::list<Entry>::iterator> index;
+
+  std::size_t m_capacity;
+  std::size_t bytes;
+  std::size_t hits;
+  std::size_t misses;
+  std::size_t evictions;
+};
+
+#endif
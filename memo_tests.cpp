@@ -0,0 +1,173 @@
+#include "catch.hpp"
+
+#include <string>
+#include <sstream>
+#include <limits>
+
+#include "interpreter.hpp"
+#include "expression.hpp"
+#include "semantic_error.hpp"
+#include "memo.hpp"
+#include "sequence.hpp"
+
+// evaluate program in interp
+static Expression eval_in(Interpreter & interp, const std::string & program) {
+	std::istringstream iss(program);
+	REQUIRE(interp.parseStream(iss));
+	return interp.evaluate();
+}
+
+TEST_CASE("Test structural hash and identical", "[memo]") {
+	std::vector<Expression> a = { Expression(1.), Expression(Atom("x")) };
+	std::vector<Expression> b = { Expression(1.), Expression(Atom("x")) };
+	std::vector<Expression> c = { Expression(1.), Expression(Atom("y")) };
+	REQUIRE(Expression(a).hash() == Expression(b).hash());
+	REQUIRE(Expression(a).identical(Expression(b)));
+	REQUIRE_FALSE(Expression(a).identical(Expression(c)));
+	REQUIRE(Expression(0.).hash() == Expression(-0.).hash());
+
+	// operator== allows a tolerance, identical does not
+	double near = 1. + std::numeric_limits<double>::epsilon();
+	REQUIRE(Expression(1.) == Expression(near));
+	REQUIRE_FALSE(Expression(1.).identical(Expression(near)));
+}
+
+TEST_CASE("Test memo cache hits, misses and eviction", "[memo]") {
+	MemoCache cache;
+	Expression lambda(7.);
+	std::vector<Expression> args = { Expression(2.) };
+	std::uint64_t key = MemoCache::key(lambda, args);
+
+	Expression result;
+	REQUIRE_FALSE(cache.lookup(key, lambda, args, result));
+	cache.insert(key, lambda, args, Expression(4.));
+	REQUIRE(cache.lookup(key, lambda, args, result));
+	REQUIRE(result == Expression(4.));
+
+	MemoStats stats = cache.stats();
+	REQUIRE(stats.hits == 1);
+	REQUIRE(stats.misses == 1);
+	REQUIRE(stats.entries == 1);
+	REQUIRE(stats.bytes > 0);
+
+	// shrinking below one entry evicts it
+	cache.setCapacity(stats.bytes - 1);
+	REQUIRE(cache.stats().entries == 0);
+	REQUIRE(cache.stats().evictions == 1);
+	REQUIRE_FALSE(cache.lookup(key, lambda, args, result));
+}
+
+TEST_CASE("Test memo cache evicts the least recently used entry", "[memo]") {
+	MemoCache cache;
+	Expression zero(0.);
+	std::vector<Expression> one = { Expression(1.) };
+	std::vector<Expression> two = { Expression(2.) };
+	std::vector<Expression> three = { Expression(3.) };
+	cache.insert(MemoCache::key(zero, one), zero, one, Expression(1.));
+	std::size_t entry = cache.stats().bytes;
+	cache.insert(MemoCache::key(zero, two), zero, two, Expression(2.));
+	cache.setCapacity(2 * entry);
+
+	// touch one so that two is the oldest
+	Expression result;
+	REQUIRE(cache.lookup(MemoCache::key(zero, one), zero, one, result));
+	cache.insert(MemoCache::key(zero, three), zero, three, Expression(3.));
+	REQUIRE(cache.lookup(MemoCache::key(zero, one), zero, one, result));
+	REQUIRE_FALSE(cache.lookup(MemoCache::key(zero, two), zero, two, result));
+	REQUIRE(cache.lookup(MemoCache::key(zero, three), zero, three, result));
+}
+
+TEST_CASE("Test a memo hit compares the lambda, not only the key", "[memo]") {
+	MemoCache cache;
+	Expression square(Atom("square"));
+	Expression cube(Atom("cube"));
+	std::vector<Expression> args = { Expression(2.) };
+
+	// a key shared by two lambdas, as a hash collision would give
+	std::uint64_t key = MemoCache::key(square, args);
+	cache.insert(key, square, args, Expression(4.));
+	Expression result;
+	REQUIRE_FALSE(cache.lookup(key, cube, args, result));
+	REQUIRE(cache.lookup(key, square, args, result));
+	REQUIRE(result == Expression(4.));
+}
+
+TEST_CASE("Test lazy lists hash without producing their elements", "[memo]") {
+	Expression huge = Expression::fromSequence(RangeSequence::make(0, 1e15, 1));
+	Expression same = Expression::fromSequence(RangeSequence::make(0, 1e15, 1));
+	Expression other = Expression::fromSequence(RangeSequence::make(1, 1e15 + 1, 1));
+	REQUIRE(huge.hash() == same.hash());
+	REQUIRE(huge.identical(same));
+	REQUIRE_FALSE(huge.identical(other));
+	REQUIRE(huge.isLazy());
+
+	// a lazy list is still identical to the same list materialized
+	Expression small = Expression::fromSequence(RangeSequence::make(0, 3, 1));
+	std::vector<Expression> elements = { Expression(0.), Expression(1.), Expression(2.), Expression(3.) };
+	Expression list(elements);
+	list.head().setList();
+	small.hash();
+	list.hash();
+	REQUIRE(small.identical(list));
+	REQUIRE(list.identical(small));
+}
+
+TEST_CASE("Test memoized results are not reused after a global changes", "[memo]") {
+	Interpreter interp;
+	REQUIRE(eval_in(interp, "(begin (define a 2) (define f (memoize (lambda (x) (* a x)))) (f 3))") == Expression(6.));
+	REQUIRE(eval_in(interp, "(begin (define a 10) (f 3))") == Expression(30.));
+	// through a lambda it calls
+	REQUIRE(eval_in(interp, "(begin (define g (lambda (x) (+ a x))) (define h (memoize (lambda (x) (g x)))) (h 1))") == Expression(11.));
+	REQUIRE(eval_in(interp, "(begin (define g (lambda (x) (- a x))) (h 1))") == Expression(9.));
+	REQUIRE(eval_in(interp, "(begin (define a 5) (map h (list 1 1)))") == Expression(std::vector<Expression>(2, Expression(4.))));
+
+	// unchanged globals still hit
+	std::size_t hits = interp.memoStats().hits;
+	REQUIRE(eval_in(interp, "(h 1)") == Expression(4.));
+	REQUIRE(interp.memoStats().hits == hits + 1);
+
+	// a callee redefined to read a global the old one did not
+	REQUIRE(eval_in(interp, "(begin (define b 1) (define g (lambda (x) (* b x))) (h 7))") == Expression(7.));
+	REQUIRE(eval_in(interp, "(begin (define b 2) (h 7))") == Expression(14.));
+}
+
+TEST_CASE("Test memoize special-form", "[memo]") {
+	Interpreter interp;
+	Expression result = eval_in(interp, "(begin (define sq (memoize (lambda (x) (* x x)))) (map sq (list 2 3 2 2 3)))");
+	std::vector<Expression> expected = { Expression(4.), Expression(9.), Expression(4.), Expression(4.), Expression(9.) };
+	REQUIRE(result == Expression(expected));
+
+	MemoStats stats = interp.memoStats();
+	REQUIRE(stats.misses == 2);
+	REQUIRE(stats.hits == 3);
+
+	std::vector<Expression> counters = { Expression(3.), Expression(2.), Expression(0.), Expression(2.), Expression(double(stats.bytes)) };
+	REQUIRE(eval_in(interp, "(memo-stats)") == Expression(counters));
+}
+
+TEST_CASE("Test automatic memoization of pure lambdas", "[memo]") {
+	Interpreter interp;
+	interp.setAutoMemoize(true);
+	eval_in(interp, "(begin (define a 2) (define sq (lambda (x) (* x x))) (define ga (lambda (x) (* a x))) (list (map sq (list 1 1 1)) (map ga (list 1 1 1))))");
+
+	// only the pure lambda is cached
+	MemoStats stats = interp.memoStats();
+	REQUIRE(stats.misses == 1);
+	REQUIRE(stats.hits == 2);
+
+	// a zero capacity turns caching off
+	interp.setMemoCapacity(0);
+	eval_in(interp, "(map sq (list 5 5))");
+	REQUIRE(interp.memoStats().entries == 0);
+}
+
+TEST_CASE("Test memoize errors", "[memo]") {
+	std::vector<std::string> programs = { "(memoize 1)", "(memoize)", "(memoize + -)" };
+	for (auto s : programs) {
+		INFO(s);
+		Interpreter interp;
+		std::istringstream iss(s);
+		REQUIRE(interp.parseStream(iss));
+		REQUIRE_THROWS_AS(interp.evaluate(), SemanticError);
+	}
+}
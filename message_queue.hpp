@@ -1,33 +1,149 @@
 #ifndef MESSAGE_QUEUE_HPP
 #define MESSAGE_QUEUE_HPP
-#include <queue>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <string>
-#include <condition_variable>
 #include <thread>
+#include <utility>
+#include <vector>
+
+// A word threads can sleep on until another thread bumps it. On Linux this
+// is a futex, elsewhere a mutex and condition variable stand in.
+class WaitWord
+{
+public:
+	WaitWord();
+
+	// the current value, pass it to wait to sleep until it changes
+	std::uint32_t prepare() const;
+
+	// sleep while the word still holds seen, may wake spuriously
+	void wait(std::uint32_t seen);
+
+	// wait for at most timeout. On Linux a signal handled by the sleeping
+	// thread also ends the wait.
+	void wait_for(std::uint32_t seen, std::chrono::nanoseconds timeout);
+
+	// bump the word and wake every sleeper
+	void notify_all();
 
+private:
+	std::atomic<std::uint32_t> word;
+#ifndef __linux__
+	std::mutex word_mutex;
+	std::condition_variable word_condition;
+#endif
+};
+
+// A bounded multi-producer multi-consumer queue that never takes a lock on
+// the push and pop paths. Each slot carries a sequence number telling
+// producers and consumers whose turn it is (Vyukov's bounded queue).
+// Blocking calls spin briefly before sleeping on a WaitWord.
 template<typename T>
 class MsgSafeQueue
 {
 public: 
+	// the number of slots when none is given
+	static const std::size_t default_capacity = 1024;
+
+	// capacity is rounded up to a power of two
+	explicit MsgSafeQueue(std::size_t capacity = default_capacity);
+
+	MsgSafeQueue(const MsgSafeQueue &) = delete;
+	MsgSafeQueue & operator=(const MsgSafeQueue &) = delete;
+
+	// push, waiting for room while the queue is full
 	void push(const T & val);
 
+	// push by moving val into the queue
+	void push(T && val);
+
+	// construct the message from args and move it in
+	template<typename... Args>
+	void emplace(Args &&... args);
+
+	// push without waiting, false if the queue is full
+	bool try_push(const T & val);
+
+	// try_push moving val in, val is left alone if the queue is full
+	bool try_push(T && val);
+
 	bool empty() const;
 
+	// pops move the message out of the queue
 	bool try_pop(T & pop_val);
 
 	void wait_and_pop(T & pop_val);
 
+	// wait_and_pop giving up after timeout, false if nothing arrived
+	template<typename Rep, typename Period>
+	bool wait_and_pop_for(T & pop_val, const std::chrono::duration<Rep, Period> & timeout);
+
+	// wait_and_pop that gives up, returning false, once flag is non-zero. A
+	// signal handler setting flag wakes the wait at once when the signal is
+	// delivered to the waiting thread, otherwise within flag_poll.
+	bool wait_and_pop_unless(T & pop_val, const volatile std::sig_atomic_t & flag);
+
+	// move every message ready now to the back of out with one claim on the
+	// queue, returns how many were taken
+	std::size_t pop_all(std::vector<T> & out);
+
+	// the number of slots
+	std::size_t capacity() const;
+
 private:
-	std::queue<T> msg_queue;
+	struct Slot {
+		std::atomic<std::size_t> sequence;
+		T value;
+	};
+
+	// spins before a blocking call goes to sleep
+	static const int spin_limit = 64;
+
+	// the longest sleep of wait_and_pop_unless between looks at its flag
+	static const int flag_poll_ms = 50;
+
+	// the push paths for copies and moves
+	template<typename U>
+	bool push_value(U && val);
+
+	template<typename U>
+	void push_waiting(U && val);
+
+	// wake pushers waiting for room after slots were freed
+	void notify_popped();
+
+	// the blocking pop, giving up at deadline or once flag is set; either
+	// may be left out with time_point::max() and nullptr
+	bool pop_waiting(T & pop_val, std::chrono::steady_clock::time_point deadline,
+		const volatile std::sig_atomic_t * flag);
+
+	std::unique_ptr<Slot[]> slots;
+	std::size_t mask;
+
+	// producers and consumers each get their own cache line, padded rather
+	// than aligned since queues are made with new
+	char pad_before[64];
+	std::atomic<std::size_t> enqueue_pos;
+	char pad_enqueue[64];
+	std::atomic<std::size_t> dequeue_pos;
+	char pad_dequeue[64];
 
-	mutable std::mutex msg_mutex;
-	
-	std::condition_variable msg_condition_var;
+	// sleepers waiting for a message, and for room
+	std::atomic<int> pop_waiters;
+	std::atomic<int> push_waiters;
+	WaitWord pushed;
+	WaitWord popped;
 };
 
 
 #include "message_queue.tpp"
 
-#endif
\ No newline at end of file
+#endif
@@ -1,38 +1,301 @@
 #include "message_queue.hpp"
 
+#ifdef __linux__
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+inline WaitWord::WaitWord(): word(0) {}
+
+inline std::uint32_t WaitWord::prepare() const {
+	return word.load(std::memory_order_acquire);
+}
+
+#ifdef __linux__
+
+inline void WaitWord::wait(std::uint32_t seen) {
+	syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT_PRIVATE, seen, nullptr, nullptr, 0);
+}
+
+inline void WaitWord::wait_for(std::uint32_t seen, std::chrono::nanoseconds timeout) {
+	// FUTEX_WAIT takes a relative timeout and returns early with EINTR when
+	// a signal handler runs on this thread
+	struct timespec relative;
+	relative.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+	relative.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+	syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAIT_PRIVATE, seen, &relative, nullptr, 0);
+}
+
+inline void WaitWord::notify_all() {
+	word.fetch_add(1, std::memory_order_seq_cst);
+	syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+#else
+
+inline void WaitWord::wait(std::uint32_t seen) {
+	std::unique_lock<std::mutex> lock(word_mutex);
+	word_condition.wait(lock, [this, seen]() { return word.load() != seen; });
+}
+
+inline void WaitWord::wait_for(std::uint32_t seen, std::chrono::nanoseconds timeout) {
+	std::unique_lock<std::mutex> lock(word_mutex);
+	word_condition.wait_for(lock, timeout, [this, seen]() { return word.load() != seen; });
+}
+
+inline void WaitWord::notify_all() {
+	{
+		std::lock_guard<std::mutex> lock(word_mutex);
+		word.fetch_add(1, std::memory_order_seq_cst);
+	}
+	word_condition.notify_all();
+}
+
+#endif
+
+template<typename T>
+MsgSafeQueue<T>::MsgSafeQueue(std::size_t capacity):
+	enqueue_pos(0), dequeue_pos(0), pop_waiters(0), push_waiters(0) {
+	std::size_t size = 2;
+	while (size < capacity) {
+		size *= 2;
+	}
+	slots.reset(new Slot[size]);
+	mask = size - 1;
+	for (std::size_t i = 0; i < size; i++) {
+		slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+template<typename T>
+std::size_t MsgSafeQueue<T>::capacity() const {
+	return mask + 1;
+}
+
 template<typename T>
 bool MsgSafeQueue<T>::empty() const {
-	std::lock_guard<std::mutex> lock(msg_mutex);
-	return msg_queue.empty();
+	return dequeue_pos.load(std::memory_order_acquire) >= enqueue_pos.load(std::memory_order_acquire);
+}
+
+template<typename T>
+template<typename U>
+bool MsgSafeQueue<T>::push_value(U && val) {
+	std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+	while (true) {
+		Slot & slot = slots[pos & mask];
+		std::size_t seq = slot.sequence.load(std::memory_order_acquire);
+		std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+		if (diff == 0) {
+			// the slot is free for this position, claim it
+			if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				slot.value = std::forward<U>(val);
+				slot.sequence.store(pos + 1, std::memory_order_release);
+				break;
+			}
+		}
+		else if (diff < 0) {
+			// the slot still holds the message from a lap ago
+			return false;
+		}
+		else {
+			pos = enqueue_pos.load(std::memory_order_relaxed);
+		}
+	}
+
+	// pairs with the fence in wait_and_pop so a sleeper is never missed
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (pop_waiters.load(std::memory_order_relaxed) > 0) {
+		pushed.notify_all();
+	}
+	return true;
+}
+
+template<typename T>
+template<typename U>
+void MsgSafeQueue<T>::push_waiting(U && val) {
+	// val is only moved from by the push that succeeds
+	for (int spin = 0; spin < spin_limit; spin++) {
+		if (push_value(std::forward<U>(val))) {
+			return;
+		}
+		std::this_thread::yield();
+	}
+	while (true) {
+		push_waiters.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		std::uint32_t seen = popped.prepare();
+		if (push_value(std::forward<U>(val))) {
+			push_waiters.fetch_sub(1, std::memory_order_relaxed);
+			return;
+		}
+		popped.wait(seen);
+		push_waiters.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+template<typename T>
+bool MsgSafeQueue<T>::try_push(const T& val) {
+	return push_value(val);
+}
+
+template<typename T>
+bool MsgSafeQueue<T>::try_push(T&& val) {
+	return push_value(std::move(val));
 }
 
 template<typename T>
 void MsgSafeQueue<T>::push(const T& val) {
-	std::unique_lock<std::mutex> lock(msg_mutex);
-	msg_queue.push(val);
-	lock.unlock();
-	msg_condition_var.notify_one();
+	push_waiting(val);
+}
+
+template<typename T>
+void MsgSafeQueue<T>::push(T&& val) {
+	push_waiting(std::move(val));
+}
+
+template<typename T>
+template<typename... Args>
+void MsgSafeQueue<T>::emplace(Args &&... args) {
+	push_waiting(T(std::forward<Args>(args)...));
+}
+
+template<typename T>
+void MsgSafeQueue<T>::notify_popped() {
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (push_waiters.load(std::memory_order_relaxed) > 0) {
+		popped.notify_all();
+	}
 }
 
 template<typename T>
 bool MsgSafeQueue<T>::try_pop(T &pop_val) {
-	std::lock_guard<std::mutex> lock(msg_mutex);
-	if (msg_queue.empty()) {
-		return false;
+	std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+	while (true) {
+		Slot & slot = slots[pos & mask];
+		std::size_t seq = slot.sequence.load(std::memory_order_acquire);
+		std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+		if (diff == 0) {
+			// a message is ready at this position, claim it
+			if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+				pop_val = std::move(slot.value);
+				slot.value = T();
+				slot.sequence.store(pos + mask + 1, std::memory_order_release);
+				break;
+			}
+		}
+		else if (diff < 0) {
+			// nothing pushed here yet
+			return false;
+		}
+		else {
+			pos = dequeue_pos.load(std::memory_order_relaxed);
+		}
 	}
 
-	pop_val = msg_queue.front();
-	msg_queue.pop();
+	notify_popped();
 	return true;
 }
 
 template<typename T>
-void MsgSafeQueue<T>::wait_and_pop(T &pop_val) {
-	std::unique_lock<std::mutex> lock(msg_mutex);
-	while (msg_queue.empty()) {
-		msg_condition_var.wait(lock);
+std::size_t MsgSafeQueue<T>::pop_all(std::vector<T> & out) {
+	std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+	std::size_t count;
+	while (true) {
+		// count the run of ready messages, then claim all of them at once;
+		// no other consumer can take them once the claim succeeds
+		count = 0;
+		while (count <= mask &&
+			slots[(pos + count) & mask].sequence.load(std::memory_order_acquire) == pos + count + 1) {
+			count++;
+		}
+		if (count == 0) {
+			return 0;
+		}
+		if (dequeue_pos.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+			break;
+		}
 	}
 
-	pop_val = msg_queue.front();
-	msg_queue.pop();
+	out.reserve(out.size() + count);
+	for (std::size_t i = 0; i < count; i++) {
+		Slot & slot = slots[(pos + i) & mask];
+		out.push_back(std::move(slot.value));
+		slot.value = T();
+		slot.sequence.store(pos + i + mask + 1, std::memory_order_release);
+	}
+
+	notify_popped();
+	return count;
+}
+
+template<typename T>
+bool MsgSafeQueue<T>::pop_waiting(T &pop_val, std::chrono::steady_clock::time_point deadline,
+	const volatile std::sig_atomic_t * flag) {
+	typedef std::chrono::steady_clock Clock;
+	const bool forever = (deadline == Clock::time_point::max());
+
+	// messages usually follow each other closely, spin a little first
+	for (int spin = 0; spin < spin_limit; spin++) {
+		if (try_pop(pop_val)) {
+			return true;
+		}
+		if (flag && *flag != 0) {
+			return false;
+		}
+		std::this_thread::yield();
+	}
+	while (true) {
+		pop_waiters.fetch_add(1, std::memory_order_seq_cst);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		std::uint32_t seen = pushed.prepare();
+		if (try_pop(pop_val)) {
+			pop_waiters.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+		if (flag && *flag != 0) {
+			pop_waiters.fetch_sub(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		if (forever && !flag) {
+			pushed.wait(seen);
+		}
+		else {
+			std::chrono::nanoseconds sleep = std::chrono::milliseconds(flag_poll_ms);
+			if (!forever) {
+				Clock::time_point now = Clock::now();
+				if (now >= deadline) {
+					pop_waiters.fetch_sub(1, std::memory_order_relaxed);
+					return false;
+				}
+				std::chrono::nanoseconds remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now);
+				if (!flag || remaining < sleep) {
+					sleep = remaining;
+				}
+			}
+			pushed.wait_for(seen, sleep);
+		}
+		pop_waiters.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+template<typename T>
+void MsgSafeQueue<T>::wait_and_pop(T &pop_val) {
+	pop_waiting(pop_val, std::chrono::steady_clock::time_point::max(), nullptr);
+}
+
+template<typename T>
+template<typename Rep, typename Period>
+bool MsgSafeQueue<T>::wait_and_pop_for(T &pop_val, const std::chrono::duration<Rep, Period> & timeout) {
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+		std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+	return pop_waiting(pop_val, deadline, nullptr);
+}
+
+template<typename T>
+bool MsgSafeQueue<T>::wait_and_pop_unless(T &pop_val, const volatile std::sig_atomic_t & flag) {
+	return pop_waiting(pop_val, std::chrono::steady_clock::time_point::max(), &flag);
 }
@@ -0,0 +1,120 @@
+/*
+Throughput and latency benchmark for MsgSafeQueue.
+
+Throughput: producers push N integers in total through the queue while one
+consumer pops them with wait_and_pop. Latency: two threads bounce a message
+back and forth through a pair of queues, the round trip time is reported.
+Each case is also run on a plain mutex-and-condition-variable queue, the
+design MsgSafeQueue replaced, for comparison.
+
+usage: message_queue_bench [N]
+*/
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "message_queue.hpp"
+
+// the mutex based queue, kept here as the baseline
+template<typename T>
+class MutexQueue {
+public:
+	void push(const T & val) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push(val);
+		}
+		condition.notify_one();
+	}
+
+	void wait_and_pop(T & val) {
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [this]() { return !queue.empty(); });
+		val = queue.front();
+		queue.pop();
+	}
+
+private:
+	std::queue<T> queue;
+	std::mutex mutex;
+	std::condition_variable condition;
+};
+
+// seconds to move n messages from producers threads to one consumer
+template<typename Queue>
+static double throughput(Queue & queue, int producers, long n) {
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (int p = 0; p < producers; p++) {
+		threads.emplace_back([&queue, producers, n]() {
+			for (long i = 0; i < n / producers; i++) {
+				queue.push(i);
+			}
+		});
+	}
+	long value;
+	for (long i = 0; i < (n / producers) * producers; i++) {
+		queue.wait_and_pop(value);
+	}
+	for (auto & t : threads) {
+		t.join();
+	}
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// mean round trip in microseconds over n exchanges
+template<typename Queue>
+static double round_trip(Queue & there, Queue & back, long n) {
+	std::thread echo([&there, &back, n]() {
+		long value;
+		for (long i = 0; i < n; i++) {
+			there.wait_and_pop(value);
+			back.push(value);
+		}
+	});
+	auto start = std::chrono::steady_clock::now();
+	long value;
+	for (long i = 0; i < n; i++) {
+		there.push(i);
+		back.wait_and_pop(value);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	echo.join();
+	return seconds * 1e6 / n;
+}
+
+int main(int argc, char * argv[]) {
+	long n = 1000000;
+	if (argc > 1) {
+		n = std::atol(argv[1]);
+	}
+	if (n <= 0) {
+		std::cerr << "usage: message_queue_bench [N]" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	for (int producers : { 1, 4 }) {
+		MsgSafeQueue<long> ring;
+		MutexQueue<long> locked;
+		double r = throughput(ring, producers, n);
+		double m = throughput(locked, producers, n);
+		std::cout << producers << " producer(s), " << n << " messages:" << std::endl
+			<< "  ring   " << n / r / 1e6 << " M msg/s" << std::endl
+			<< "  mutex  " << n / m / 1e6 << " M msg/s" << std::endl;
+	}
+
+	long trips = n / 10 > 0 ? n / 10 : 1;
+	MsgSafeQueue<long> ring_there, ring_back;
+	MutexQueue<long> locked_there, locked_back;
+	std::cout << "round trip, " << trips << " exchanges:" << std::endl
+		<< "  ring   " << round_trip(ring_there, ring_back, trips) << " us" << std::endl
+		<< "  mutex  " << round_trip(locked_there, locked_back, trips) << " us" << std::endl;
+
+	return EXIT_SUCCESS;
+}
@@ -4,6 +4,10 @@
 #include "expression.hpp"
 #include <string>
 #include <utility>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <csignal>
 
 
 TEST_CASE("Testing the basics of message_queue", "[message_queue]") {
@@ -30,4 +34,127 @@ TEST_CASE("Testing multiple threads", "[message_queue]") {
 	msg.push(par);
 	msg.wait_and_pop(parb);
 	REQUIRE(par == parb);
-}
\ No newline at end of file
+}
+TEST_CASE("Testing a full queue", "[message_queue]") {
+	MsgSafeQueue<int> msg(3);
+	REQUIRE(msg.capacity() == 4);
+	for (int i = 0; i < 4; i++) {
+		REQUIRE(msg.try_push(i));
+	}
+	REQUIRE(!msg.try_push(4));
+
+	int value = -1;
+	REQUIRE(msg.try_pop(value));
+	REQUIRE(value == 0);
+	REQUIRE(msg.try_push(4));
+	for (int i = 1; i <= 4; i++) {
+		REQUIRE(msg.try_pop(value));
+		REQUIRE(value == i);
+	}
+	REQUIRE(msg.empty());
+}
+
+TEST_CASE("Testing many producers and one consumer", "[message_queue]") {
+	// a small queue so producers have to wait for room
+	MsgSafeQueue<int> msg(8);
+	const int producers = 4;
+	const int per_producer = 5000;
+
+	std::vector<std::thread> threads;
+	for (int p = 0; p < producers; p++) {
+		threads.emplace_back([&msg, p]() {
+			for (int i = 0; i < per_producer; i++) {
+				msg.push(p * per_producer + i);
+			}
+		});
+	}
+
+	// every message arrives once, and in order for each producer
+	std::vector<int> last(producers, -1);
+	long long sum = 0;
+	for (int i = 0; i < producers * per_producer; i++) {
+		int value;
+		msg.wait_and_pop(value);
+		int p = value / per_producer;
+		REQUIRE(value > last[p]);
+		last[p] = value;
+		sum += value;
+	}
+	for (auto & t : threads) {
+		t.join();
+	}
+	long long n = producers * per_producer;
+	REQUIRE(sum == n * (n - 1) / 2);
+	REQUIRE(msg.empty());
+}
+
+TEST_CASE("Testing moves and emplace", "[message_queue]") {
+	MsgSafeQueue<std::pair<Expression, std::string>> msg;
+	std::vector<Expression> tail = { Expression(1.), Expression(2.) };
+	Expression list(tail);
+
+	std::pair<Expression, std::string> par = { list, "" };
+	msg.push(std::move(par));
+	REQUIRE(par.first.tailSize() == 0);
+
+	msg.emplace(Expression(3.), "error");
+
+	std::pair<Expression, std::string> out;
+	REQUIRE(msg.try_pop(out));
+	REQUIRE(out.first == list);
+	msg.wait_and_pop(out);
+	REQUIRE(out.first == Expression(3.));
+	REQUIRE(out.second == "error");
+	REQUIRE(msg.empty());
+}
+
+TEST_CASE("Testing pop_all", "[message_queue]") {
+	MsgSafeQueue<std::string> msg(4);
+	std::vector<std::string> out;
+	REQUIRE(msg.pop_all(out) == 0);
+
+	// drains a burst, wrapping around the ring
+	for (int lap = 0; lap < 3; lap++) {
+		for (int i = 0; i < 3; i++) {
+			msg.push(std::to_string(lap * 3 + i));
+		}
+		REQUIRE(msg.pop_all(out) == 3);
+	}
+	REQUIRE(out.size() == 9);
+	for (int i = 0; i < 9; i++) {
+		REQUIRE(out[i] == std::to_string(i));
+	}
+	REQUIRE(msg.empty());
+}
+
+TEST_CASE("Testing timed waits", "[message_queue]") {
+	MsgSafeQueue<int> msg;
+	int value = 0;
+	REQUIRE(!msg.wait_and_pop_for(value, std::chrono::milliseconds(10)));
+
+	std::thread producer([&msg]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		msg.push(5);
+	});
+	REQUIRE(msg.wait_and_pop_for(value, std::chrono::seconds(10)));
+	REQUIRE(value == 5);
+	producer.join();
+}
+
+TEST_CASE("Testing waits that give up on a flag", "[message_queue]") {
+	MsgSafeQueue<int> msg;
+	volatile std::sig_atomic_t flag = 0;
+	int value = 0;
+
+	msg.push(1);
+	REQUIRE(msg.wait_and_pop_unless(value, flag));
+	REQUIRE(value == 1);
+
+	std::thread interrupter([&flag]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		flag = 1;
+	});
+	REQUIRE(!msg.wait_and_pop_unless(value, flag));
+	interrupter.join();
+	REQUIRE(msg.empty());
+}
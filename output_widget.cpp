@@ -7,19 +7,8 @@ OutputWidget::OutputWidget(QWidget * parent) : QWidget(parent) {
 	layout->addWidget(childView);
 	childView->setScene(childScene);
 
-	std::ifstream ifs(STARTUP_FILE);
-	if (!interp.parseStream(ifs)) {
-		childScene->addText(QString("Error: Invalid, could not parse"));
-	}
-	else {
-		try {
-			Expression exp = interp.evaluate();
-		}
-		catch (const SemanticError & ex) {
-			QString error = QString(ex.what());
-			childScene->addText(error);
-		}
-	}
+	// the startup definitions were evaluated when the notebook was built
+	interp = Interpreter(startup_snapshot);
 	newInterp = interp;
 	cons = Consumer(iq, oq);
 	cons.setThreadRunTrue();
@@ -31,7 +20,7 @@ OutputWidget::OutputWidget(QWidget * parent) : QWidget(parent) {
 
 OutputWidget::~OutputWidget() {
 	if (cons.getThreadRun()) {
-		std::string st;
+		request st;
 		iq->push(st);
 		if (t1.joinable()) {
 			t1.join();
@@ -54,7 +43,7 @@ void OutputWidget::start() {
 void OutputWidget::stop() {
 	if (cons.getThreadRun()) {
 		cons.setThreadRunFalse();
-		std::string st;
+		request st;
 		iq->push(st);
 		if (t1.joinable()) {
 			t1.join();
@@ -79,7 +68,7 @@ void OutputWidget::reset() {
 
 void OutputWidget::interrupt() {
 	childScene->clear();
-	global_status_flag = 1;
+	current.cancel();
 }
 
 void OutputWidget::timerStart() {
@@ -163,7 +152,6 @@ void OutputWidget::timerStart() {
 }
 
 void OutputWidget::receiveString(QString str) {
-	global_status_flag = 0;
 	if (!cons.getThreadRun()) {
 		childScene->clear();
 		QString error = "Error: interpreter kernel not running";
@@ -173,7 +161,8 @@ void OutputWidget::receiveString(QString str) {
 		childView->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 	}
 	else {
-		iq->push(str.toStdString());
+		current = CancelToken();
+		iq->push(request(str.toStdString(), current));
 		std::this_thread::sleep_for(std::chrono::milliseconds(100));
 	}
 }
@@ -17,12 +17,15 @@
 #include <utility>
 #include <chrono>
 
-#include "startup_config.hpp"
+#include "snapshot.hpp"
 #include "interpreter.hpp"
 #include "semantic_error.hpp"
 #include "expression.hpp"
+#include "cancel.hpp"
 
-typedef MsgSafeQueue<std::string> inputQueue;
+// a program with the token that cancels it, an empty program stops the kernel
+typedef std::pair<std::string, CancelToken> request;
+typedef MsgSafeQueue<request> inputQueue;
 typedef std::pair<Expression, std::string> output;
 typedef MsgSafeQueue<output> outputQueue;
 
@@ -40,11 +43,11 @@ public:
 
 	void operator()(Interpreter interp) {
 		while (1) {
-			std::string temp;
+			request temp;
 			Expression exp;
 			mqi->wait_and_pop(temp);
-			std::istringstream expression(temp);
-			if (temp.empty()) {
+			std::istringstream expression(temp.first);
+			if (temp.first.empty()) {
 				break;
 			}
 			std::string error;
@@ -53,14 +56,13 @@ public:
 			}
 			else {
 				try {
-					exp = interp.evaluate();
+					exp = interp.evaluate(temp.second);
 				}
 				catch (const SemanticError & ex) {
 					error = ex.what();
 				}
 			}
-			output out = std::make_pair(exp, error);
-			mqo->push(out);
+			mqo->emplace(std::move(exp), std::move(error));
 		}
 	}
 
@@ -109,5 +111,7 @@ private:
 	Interpreter newInterp;
 	QTimer *timer;
 	output outpair;
+	// the token of the last program sent to the kernel
+	CancelToken current;
 };
 #endif
\ No newline at end of file
@@ -2,19 +2,61 @@
 #include <sstream>
 #include <iostream>
 #include <fstream>
+#include <cstdio>
 #include <utility>
-
-#include "startup_config.hpp"
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iomanip>
+#include <thread>
+#include <stdexcept>
+
+#include "snapshot.hpp"
 #include "interpreter.hpp"
 #include "semantic_error.hpp"
 #include "message_queue.hpp"
 #include "expression.hpp"
+#include "cancel.hpp"
+#include "batch.hpp"
+#include "server.hpp"
 #include <csignal>
 #include <cstdlib>
 
-typedef MsgSafeQueue<std::string> inputQueue;
-typedef std::pair<Expression, std::string> output;
-typedef MsgSafeQueue<output> outputQueue;
+// a line for the kernel, numbered in the order it was submitted, with the
+// token that cancels it. An empty line asks the kernel to stop.
+struct Submission {
+	Submission(): id(0) {}
+	Submission(std::size_t n, const std::string & text, const CancelToken & cancel):
+		id(n), line(text), token(cancel) {}
+
+	std::size_t id;
+	std::string line;
+	CancelToken token;
+};
+
+// the answer to a submission, the error is empty on success and the note
+// is set instead of a result for kernel commands. Id zero asks the printer
+// to stop.
+struct Result {
+	Result(): id(0) {}
+	Result(std::size_t n, Expression && e, std::string && err):
+		id(n), exp(std::move(e)), error(std::move(err)) {}
+
+	std::size_t id;
+	Expression exp;
+	std::string error;
+	std::string note;
+};
+
+typedef MsgSafeQueue<Submission> inputQueue;
+typedef MsgSafeQueue<Result> outputQueue;
+
+// serializes writes to the console once results print from their own thread
+std::mutex console_mutex;
+
+// the evaluation Cntl-C cancels when a program runs outside the REPL
+const CancelToken * volatile foreground_token = nullptr;
 
 // This global is needed for communication between the signal handler
 // and the rest of the code. This atomic integer counts the number of times
@@ -36,6 +78,9 @@ BOOL WINAPI interrupt_handler(DWORD fdwCtrlType) {
       exit(EXIT_FAILURE);
     }
     ++global_status_flag;
+    if (foreground_token) {
+      foreground_token->cancel();
+    }
     return TRUE;
 
   default:
@@ -63,6 +108,9 @@ void interrupt_handler(int signal_num) {
       exit(EXIT_FAILURE);
     }
     ++global_status_flag;
+    if (foreground_token) {
+      foreground_token->cancel();
+    }
   }
 }
 
@@ -80,65 +128,264 @@ inline void install_handler() {
 #endif
 // *****************************************************************************
 
+// Interpreters saved by %checkpoint, by name. Copies of an interpreter
+// share its definitions until one of them changes, so saving and restoring
+// take constant time however much has been defined.
+class Checkpoints {
+public:
+	void save(const std::string & name, const Interpreter & interp) {
+		std::lock_guard<std::mutex> lock(mutex);
+		saved.erase(name);
+		saved.emplace(name, interp);
+	}
+
+	// false if there is no checkpoint called name
+	bool restore(const std::string & name, Interpreter & interp) {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<std::string, Interpreter>::const_iterator found = saved.find(name);
+		if (found == saved.end()) {
+			return false;
+		}
+		interp.restore(found->second);
+		return true;
+	}
+
+	std::vector<std::string> names() {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<std::string> result;
+		for (auto & entry : saved) {
+			result.push_back(entry.first);
+		}
+		return result;
+	}
+
+private:
+	std::mutex mutex;
+	std::map<std::string, Interpreter> saved;
+};
+
 class Consumer {
 public:
-	Consumer(inputQueue *messageQueueIn, outputQueue *messageQueueOut) {
+	Consumer(inputQueue *messageQueueIn, outputQueue *messageQueueOut, Checkpoints *checkpointsIn) {
 		mqi = messageQueueIn;
 		mqo = messageQueueOut;
+		checkpoints = checkpointsIn;
 	}
 
 	void operator()(Interpreter interp) const {
 		while (1) {
-			std::string temp;
+			Submission temp;
 			Expression exp;
 			mqi->wait_and_pop(temp);
-			if (temp.empty()) {
+			if (temp.line.empty()) {
 				return;
 			}
+			// %checkpoint and %restore run here, in order with the lines
+			// queued before them
+			if (temp.line.compare(0, 12, "%checkpoint ") == 0 || temp.line.compare(0, 9, "%restore ") == 0) {
+				mqo->push(command(temp, interp));
+				continue;
+			}
 			std::string error;
-			std::istringstream expression(temp);
+			std::istringstream expression(temp.line);
 			if (!interp.parseStream(expression)) {
 				error = "Invalid Expression. Could not parse.";
 			}
 			else {
 				try {
-					exp = interp.evaluate();
+					// a request cancelled while queued fails at once
+					exp = interp.evaluate(temp.token);
 				}
 				catch (const SemanticError & ex) {
 					error = ex.what();
 				}
 			}
-			output out = std::make_pair(exp, error);
-			mqo->push(out);
+			mqo->emplace(temp.id, std::move(exp), std::move(error));
 		}
 	}
 
 private:
+	Result command(const Submission & temp, Interpreter & interp) const {
+		Result result(temp.id, Expression(), std::string());
+		std::string name = temp.line.substr(temp.line.find(' ') + 1);
+		if (temp.line.compare(0, 12, "%checkpoint ") == 0) {
+			checkpoints->save(name, interp);
+			result.note = "saved checkpoint " + name;
+		}
+		else if (checkpoints->restore(name, interp)) {
+			result.note = "restored checkpoint " + name;
+		}
+		else {
+			result.error = "Error: no checkpoint named " + name;
+		}
+		return result;
+	}
+
 	inputQueue * mqi;
 	outputQueue * mqo;
+	Checkpoints * checkpoints;
+};
+
+// Tracks the lines submitted to the kernel and not yet answered, so %wait
+// and %status can tell what is in flight.
+class Progress {
+public:
+	Progress(): submitted(0), finished(0) {}
+
+	// number a new line and record it as in flight
+	std::size_t submit(const std::string & line, const CancelToken & token) {
+		std::lock_guard<std::mutex> lock(mutex);
+		++submitted;
+		pending[submitted] = Pending(line, token);
+		return submitted;
+	}
+
+	// cancel line id whether it is running or still queued, false if it is
+	// not in flight
+	bool cancel(std::size_t id) {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<std::size_t, Pending>::iterator found = pending.find(id);
+		if (found == pending.end()) {
+			return false;
+		}
+		found->second.token.cancel();
+		return true;
+	}
+
+	// cancel every line in flight, returns how many there were
+	std::size_t cancel_all() {
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto & entry : pending) {
+			entry.second.token.cancel();
+		}
+		return pending.size();
+	}
+
+	// results arrive in order, so every line up to id is done
+	void finish(std::size_t id) {
+		std::lock_guard<std::mutex> lock(mutex);
+		if (id > finished) {
+			finished = id;
+		}
+		pending.erase(pending.begin(), pending.upper_bound(id));
+		done.notify_all();
+	}
+
+	// wait until every submitted line is answered, false on Cntl-C
+	bool wait_all() {
+		std::unique_lock<std::mutex> lock(mutex);
+		while (!pending.empty()) {
+			if (global_status_flag > 0) {
+				return false;
+			}
+			done.wait_for(lock, std::chrono::milliseconds(50));
+		}
+		return true;
+	}
+
+	// the lines still in flight, oldest first
+	std::map<std::size_t, std::string> in_flight() {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<std::size_t, std::string> lines;
+		for (auto & entry : pending) {
+			lines[entry.first] = entry.second.line;
+		}
+		return lines;
+	}
+
+	std::size_t last_submitted() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return submitted;
+	}
+
+	std::size_t last_finished() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return finished;
+	}
+
+private:
+	struct Pending {
+		Pending() {}
+		Pending(const std::string & text, const CancelToken & cancel): line(text), token(cancel) {}
+
+		std::string line;
+		CancelToken token;
+	};
+
+	std::mutex mutex;
+	std::condition_variable done;
+	std::size_t submitted;
+	std::size_t finished;
+	std::map<std::size_t, Pending> pending;
+};
+
+// In pipelined mode prints results tagged with their line number as the
+// kernel finishes them, while the REPL goes on reading input.
+class Printer {
+public:
+	Printer(outputQueue *messageQueueOut, Progress *progressIn) {
+		mqo = messageQueueOut;
+		progress = progressIn;
+	}
+
+	void operator()() const {
+		while (1) {
+			Result out;
+			mqo->wait_and_pop(out);
+			if (out.id == 0) {
+				return;
+			}
+			{
+				std::lock_guard<std::mutex> lock(console_mutex);
+				std::cout << "[" << out.id << "] ";
+				if (!out.note.empty()) {
+					std::cout << "Info: " << out.note << std::endl;
+				}
+				else if (out.error.empty()) {
+					std::cout << out.exp << std::endl;
+				}
+				else {
+					std::cout << out.error << std::endl;
+				}
+			}
+			progress->finish(out.id);
+		}
+	}
+
+private:
+	outputQueue * mqo;
+	Progress * progress;
 };
 
 void prompt(){
-  std::cout << "\nplotscript> ";
+  std::lock_guard<std::mutex> lock(console_mutex);
+  std::cout << "\nplotscript> " << std::flush;
 }
 
 std::string readline(){
   std::string line;
   std::getline(std::cin, line);
 
-if (std::cin.fail() || std::cin.eof()) {
-      std::cin.clear(); // reset cin state
-      line.clear(); //clear input string
-    }
+  if (std::cin.fail()) {
+    line.clear(); //clear input string
+  }
+  // keep the end of input so the REPL stops, piped input ends there. A
+  // read interrupted by Cntl-C looks the same but is not the end.
+  if (!std::cin.eof() || global_status_flag > 0) {
+    std::cin.clear(); // reset cin state
+    clearerr(stdin);
+  }
 
   return line;
 }
 
 void error(const std::string & err_str){
+  std::lock_guard<std::mutex> lock(console_mutex);
   std::cerr << "Error: " << err_str << std::endl;
 }
 
 void info(const std::string & err_str){
+  std::lock_guard<std::mutex> lock(console_mutex);
   std::cout << "Info: " << err_str << std::endl;
 }
 
@@ -148,11 +395,15 @@ int eval_from_stream(std::istream & stream, Interpreter interp){
     return EXIT_FAILURE;
   }
   else{
+    CancelToken token;
+    foreground_token = &token;
     try{
-      Expression exp = interp.evaluate();
+      Expression exp = interp.evaluate(token);
+      foreground_token = nullptr;
       std::cout << exp << std::endl;
     }
     catch(const SemanticError & ex){
+      foreground_token = nullptr;
       std::cerr << ex.what() << std::endl;
       return EXIT_FAILURE;
     }	
@@ -179,17 +430,189 @@ int eval_from_command(std::string argexp, Interpreter interp){
   return eval_from_stream(expression, interp);
 }
 
-// A REPL is a repeated read-eval-print loop
-void repl(Interpreter interp){
+// Evaluate the files named in args on kernels cloned from interp. Each
+// result is written to the file's name with .out added, in the directory
+// given with -o if any, and a summary goes to standard output.
+int eval_batch(const std::vector<std::string> & args, Interpreter interp){
+  std::vector<std::string> files;
+  unsigned kernels = std::thread::hardware_concurrency();
+  std::string directory;
+  for(std::size_t i = 0; i < args.size(); i++){
+    if(args[i] == "-j" && i + 1 < args.size()){
+      std::istringstream number(args[++i]);
+      if(!(number >> kernels) || kernels == 0){
+        error("-j needs a positive number of kernels.");
+        return EXIT_FAILURE;
+      }
+    }
+    else if(args[i] == "-o" && i + 1 < args.size()){
+      directory = args[++i];
+    }
+    else{
+      files.push_back(args[i]);
+    }
+  }
+  if(files.empty()){
+    error("No files to evaluate in batch.");
+    return EXIT_FAILURE;
+  }
+
+  CancelToken token;
+  foreground_token = &token;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<BatchResult> results = run_batch(interp, files, kernels, token);
+  std::chrono::duration<double, std::milli> wall = std::chrono::steady_clock::now() - start;
+  foreground_token = nullptr;
+
+  std::size_t failed = 0;
+  double busy = 0;
+  std::cout << std::fixed << std::setprecision(1);
+  for(auto & result : results){
+    // outputs in one directory are named after the whole path so files
+    // with the same name in different directories do not collide
+    std::string path = result.file + ".out";
+    if(!directory.empty()){
+      std::string name = path;
+      for(auto & c : name){
+        if(c == '/' || c == '\\') c = '_';
+      }
+      path = directory + "/" + name;
+    }
+    std::ofstream out(path);
+    out << result.output << std::endl;
+    if(!out){
+      result.ok = false;
+      result.output = "Error: Could not write " + path + ".";
+    }
+
+    busy += result.milliseconds;
+    if(!result.ok){
+      ++failed;
+    }
+    std::cout << (result.ok ? "ok  " : "FAIL") << std::setw(10) << result.milliseconds << " ms  [" << result.kernel
+      << "]  " << result.file;
+    if(!result.ok){
+      std::cout << ": " << result.output;
+    }
+    std::cout << std::endl;
+  }
+  std::cout << results.size() << " files, " << failed << " failed, " << busy << " ms of evaluation in "
+    << wall.count() << " ms" << std::endl;
+
+  return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Answer programs sent to a socket at path until Cntl-C, each request
+// running on a copy of interp or on a named session cloned from it.
+int serve(const std::string & path, const Interpreter & interp){
+  Server server(interp);
+  try{
+    server.listen(path);
+  }
+  catch(const std::runtime_error & ex){
+    std::cerr << ex.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  info("serving on " + path);
+  server.run();
+  info("stopped serving on " + path);
+  return EXIT_SUCCESS;
+}
+
+// Set the limit called name (steps, time or memory) from text, a
+// non-negative whole number where zero means unlimited
+bool set_limit(const std::string & name, const std::string & text, Limits & limits){
+	std::istringstream number(text);
+	std::uint64_t value;
+	if(text.empty() || text[0] == '-' || !(number >> value) || !number.eof()){
+		return false;
+	}
+	if(name == "steps"){
+		limits.steps = value;
+	}
+	else if(name == "time"){
+		limits.milliseconds = value;
+	}
+	else if(name == "memory"){
+		limits.bytes = value;
+	}
+	else{
+		return false;
+	}
+	return true;
+}
+
+// Start a helper thread of the REPL. On Unix helpers block SIGINT so Cntl-C
+// is handled by the REPL thread, waking it from its wait for a result or
+// for input.
+template<typename Function, typename... Args>
+std::thread start_quiet(Function && f, Args &&... args){
+#if defined(_WIN64) || defined(_WIN32)
+	return std::thread(std::forward<Function>(f), std::forward<Args>(args)...);
+#else
+	sigset_t interrupt, previous;
+	sigemptyset(&interrupt);
+	sigaddset(&interrupt, SIGINT);
+	pthread_sigmask(SIG_BLOCK, &interrupt, &previous);
+	std::thread helper(std::forward<Function>(f), std::forward<Args>(args)...);
+	pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+	return helper;
+#endif
+}
+
+// Start the kernel thread
+std::thread start_kernel(const Consumer & cons, const Interpreter & interp){
+	return start_quiet(cons, interp);
+}
+
+// Stop the kernel once it has worked through the lines queued so far
+void stop_kernel(inputQueue * iq, std::thread & kernel){
+	iq->push(Submission());
+	kernel.join();
+}
+
+// Start printing results from their own thread
+std::thread start_printer(outputQueue * oq, Progress * progress){
+	return start_quiet(Printer(oq, progress));
+}
+
+// Stop printing results, after those already answered
+void stop_printer(outputQueue * oq, Progress * progress, std::thread & printer){
+	progress->wait_all();
+	oq->push(Result());
+	printer.join();
+}
+
+// A REPL is a repeated read-eval-print loop. In pipelined mode lines are
+// queued for the kernel without waiting and results print as they finish,
+// tagged with the number of their line. Each line is cancelled on its own:
+// Cntl-C cancels the line being waited for, or every line in flight in
+// pipelined mode, and %cancel cancels one line.
+void repl(Interpreter interp, bool pipelined){
 	bool threadRun = true;
 	inputQueue *iq = new inputQueue;
 	outputQueue *oq = new outputQueue;
-	output out;
+	Progress progress;
+	Result out;
 
+	// copies share their definitions, so keeping the state to reset to and
+	// handing the kernel its interpreter copy nothing
 	Interpreter newInterp = interp;
-	Consumer cons(iq, oq);
-	std::thread t1(cons, interp);
+	Checkpoints checkpoints;
+	Consumer cons(iq, oq, &checkpoints);
+	std::thread t1 = start_kernel(cons, interp);
+	std::thread printer;
+	if (pipelined) {
+		printer = start_printer(oq, &progress);
+	}
 	while(!std::cin.eof()){
+		// Cntl-C while reading input in pipelined mode
+		if (global_status_flag > 0 && pipelined) {
+			std::size_t cancelled = progress.cancel_all();
+			if (cancelled > 0) {
+				info("cancelled " + std::to_string(cancelled) + " in flight");
+			}
+		}
 		global_status_flag = 0;
 
 		prompt();
@@ -198,7 +621,7 @@ void repl(Interpreter interp){
 		if (line == "%start") {
 			if (!threadRun) {
 				threadRun = true;
-				t1 = std::thread(cons, interp);
+				t1 = start_kernel(cons, interp);
 			}
 			else {
 				error("Could not start the thread, already a thread running.");
@@ -209,10 +632,7 @@ void repl(Interpreter interp){
 		if (line == "%stop") {
 			if (threadRun) {
 				threadRun = false;
-				std::string str;
-				iq->push(str);
-				t1.join();
-				iq->try_pop(str);
+				stop_kernel(iq, t1);
 			}
 			else {
 				error("Could not stop the thread, already no thread running");
@@ -224,55 +644,154 @@ void repl(Interpreter interp){
 			// If not stopped
 			if (threadRun) {
 				// Stop the code
-				std::string str;
-				iq->push(str);
-				t1.join();
-				iq->try_pop(str);
+				stop_kernel(iq, t1);
 			}
 			threadRun = true;
 			// Start the code
-			t1 = std::thread(cons, interp);
 			interp = newInterp;
+			t1 = start_kernel(cons, interp);
 			continue;
 		}
 
 		if (line == "%exit") {
 			if (threadRun) {
 				threadRun = false;
-				std::string str;
-				iq->push(str);
-				t1.join();
-				iq->try_pop(str);
+				stop_kernel(iq, t1);
+			}
+			if (pipelined) {
+				stop_printer(oq, &progress, printer);
 			}
 			exit(EXIT_SUCCESS);
 		}
 
-		if (line.empty()) continue;
-		if (!threadRun) {
-			error("interpreter kernel not running");
+		if (line == "%pipeline on" || line == "%pipeline off") {
+			bool on = (line == "%pipeline on");
+			if (on && !pipelined) {
+				printer = start_printer(oq, &progress);
+			}
+			else if (!on && pipelined) {
+				stop_printer(oq, &progress, printer);
+			}
+			pipelined = on;
 			continue;
 		}
-		iq->push(line);
 
-		while (oq->empty()) {
-			if (global_status_flag > 0) {
-				std::cerr << "Error: interpreter kernel interrupted" << std::endl;
-				break;
-			}
+		if (line == "%limits") {
+			Limits limits = interp.limits();
+			info("steps " + std::to_string(limits.steps) + ", time " + std::to_string(limits.milliseconds) +
+				" ms, memory " + std::to_string(limits.bytes) + " bytes (0 is unlimited)");
+			continue;
 		}
-		oq->try_pop(out);
 
-		if (global_status_flag == 0) {
-			if (out.second.empty()) {
-				std::cout << out.first << " ";
+		if (line.compare(0, 8, "%limits ") == 0) {
+			// %limits steps|time|memory value, for the lines submitted after
+			std::istringstream words(line.substr(8));
+			std::string name, value;
+			Limits limits = interp.limits();
+			if (!(words >> name >> value) || !words.eof() || !set_limit(name, value, limits)) {
+				error("usage: %limits steps|time|memory <number>");
 			}
 			else {
-				std::cout << out.second << " ";
+				interp.setLimits(limits);
+			}
+			continue;
+		}
+
+		if (line.compare(0, 8, "%cancel ") == 0) {
+			std::size_t id = 0;
+			std::istringstream number(line.substr(8));
+			if (!(number >> id) || !progress.cancel(id)) {
+				error("no line " + line.substr(8) + " in flight");
+			}
+			continue;
+		}
+
+		if (line == "%checkpoints") {
+			std::vector<std::string> names = checkpoints.names();
+			std::string list;
+			for (const auto & name : names) {
+				list += " " + name;
+			}
+			info(names.empty() ? "no checkpoints" : "checkpoints:" + list);
+			continue;
+		}
+
+		if (line.compare(0, 12, "%checkpoint ") == 0 || line.compare(0, 9, "%restore ") == 0) {
+			// the kernel takes or restores the checkpoint once the lines
+			// before it are done, so it is submitted like one
+			std::string name = line.substr(line.find(' ') + 1);
+			if (name.empty() || name.find(' ') != std::string::npos) {
+				error("usage: %checkpoint <name> or %restore <name>");
+				continue;
+			}
+		}
+
+		if (line == "%wait") {
+			if (!progress.wait_all()) {
+				error("interrupted while waiting for the kernel");
+			}
+			continue;
+		}
+
+		if (line == "%status") {
+			std::map<std::size_t, std::string> flight = progress.in_flight();
+			std::ostringstream status;
+			status << flight.size() << " in flight, " << progress.last_finished()
+				<< " of " << progress.last_submitted() << " finished";
+			if (!threadRun) {
+				status << ", kernel not running";
+			}
+			info(status.str());
+			for (const auto & entry : flight) {
+				info("[" + std::to_string(entry.first) + "] " + entry.second);
+			}
+			continue;
+		}
+
+		if (line.empty()) continue;
+		if (!threadRun) {
+			error("interpreter kernel not running");
+			continue;
+		}
+		CancelToken token;
+		std::size_t id = progress.submit(line, token);
+		iq->emplace(id, line, token);
+		if (pipelined) {
+			continue;
+		}
+
+		// sleep until the kernel answers or Cntl-C is pressed, dropping the
+		// late answers to lines interrupted before
+		bool answered;
+		while ((answered = oq->wait_and_pop_unless(out, global_status_flag)) && out.id < id) {
+			progress.finish(out.id);
+		}
+		if (!answered) {
+			progress.cancel(id);
+			std::cerr << "Error: interpreter kernel interrupted" << std::endl;
+		}
+		else {
+			progress.finish(out.id);
+			if (global_status_flag == 0) {
+				if (!out.note.empty()) {
+					info(out.note);
+				}
+				else if (out.error.empty()) {
+					std::cout << out.exp << " ";
+				}
+				else {
+					std::cout << out.error << " ";
+				}
 			}
 		}
 	}
 
-	t1.join();
+	if (threadRun) {
+		stop_kernel(iq, t1);
+	}
+	if (pipelined) {
+		stop_printer(oq, &progress, printer);
+	}
 	delete iq;
 	delete oq;
 }
@@ -280,21 +799,44 @@ void repl(Interpreter interp){
 int main(int argc, char *argv[])
 {
 	install_handler();
-	Interpreter interp;
-	std::ifstream ifs(STARTUP_FILE);
-	if (!interp.parseStream(ifs)) {
-		error("Invalid Program. Could not parse.");
-		return EXIT_FAILURE;
-	}
-	else {
-		try {
-			Expression exp = interp.evaluate();
+	// the startup definitions were evaluated when plotscript was built
+	Interpreter interp(startup_snapshot);
+
+	// leading options, limits apply to the programs run from here on
+	bool pipelined = false;
+	Limits limits;
+	int first = 1;
+	while(first < argc && std::string(argv[first]).compare(0, 2, "--") == 0){
+		std::string option = argv[first];
+		if(option == "--pipeline"){
+			pipelined = true;
+			first += 1;
 		}
-		catch (const SemanticError & ex) {
-			std::cerr << ex.what() << std::endl;
+		else if(option == "--processes"){
+			// pmap and long maps run their chunks in forked worker processes
+			interp.setProcessParallel(true);
+			first += 1;
+		}
+		else if(option == "--batch"){
+			interp.setLimits(limits);
+			return eval_batch(std::vector<std::string>(argv + first + 1, argv + argc), interp);
+		}
+		else if(option == "--serve" && first + 2 == argc){
+			interp.setLimits(limits);
+			return serve(argv[first + 1], interp);
+		}
+		else if(option.compare(0, 6, "--max-") == 0 && first + 1 < argc &&
+			set_limit(option.substr(6), argv[first + 1], limits)){
+			first += 2;
+		}
+		else{
+			error("Unknown or incomplete option " + option + ".");
 			return EXIT_FAILURE;
 		}
 	}
+	interp.setLimits(limits);
+	argc -= first - 1;
+	argv += first - 1;
 
 	if(argc == 2){
 		return eval_from_file(argv[1], interp);
@@ -308,7 +850,7 @@ int main(int argc, char *argv[])
 		}
 	}
 	else{
-		repl(interp);
+		repl(interp, pipelined);
 	}
     
 	return EXIT_SUCCESS;
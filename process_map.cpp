@@ -0,0 +1,237 @@
+#include "process_map.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "semantic_error.hpp"
+#include "cancel.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define PROCESS_MAP_POSIX
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// what a worker reports for its chunk
+enum ChunkStatus : std::int32_t { ChunkRunning = 0, ChunkDone, ChunkNotNumeric, ChunkFailed };
+
+// the per-chunk header at the start of the arena, the results follow all
+// the headers with one slot per source element
+struct ChunkHeader {
+  std::int32_t status;
+  std::uint64_t count;
+  char message[256];
+};
+
+// thrown by the worker sink to stop at the first non-numeric result
+struct NotNumeric {};
+
+// set in a worker process before it runs its chunk
+bool map_worker = false;
+
+}
+
+SharedArena::SharedArena(std::size_t bytes): m_data(nullptr), m_size(bytes) {
+#ifdef PROCESS_MAP_POSIX
+  void * p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    throw SemanticError("Error during evaluation: could not map shared memory for map workers");
+  }
+  m_data = static_cast<char *>(p);
+#else
+  throw SemanticError("Error during evaluation: shared memory is not supported");
+#endif
+}
+
+SharedArena::~SharedArena() {
+#ifdef PROCESS_MAP_POSIX
+  munmap(m_data, m_size);
+#endif
+}
+
+char * SharedArena::data() const noexcept {
+  return m_data;
+}
+
+std::size_t SharedArena::size() const noexcept {
+  return m_size;
+}
+
+ArenaSequence::ArenaSequence(const std::shared_ptr<const SharedArena> & arena, const double * values, std::size_t count):
+  m_arena(arena), m_values(values), m_count(count) {}
+
+std::size_t ArenaSequence::size() const noexcept {
+  return m_count;
+}
+
+Expression ArenaSequence::at(std::size_t i) const noexcept {
+  return Expression(m_values[i]);
+}
+
+std::shared_ptr<const Sequence> ArenaSequence::slice(std::size_t begin, std::size_t end) const {
+  if (end > m_count) end = m_count;
+  if (begin > end) begin = end;
+  return std::make_shared<ArenaSequence>(m_arena, m_values + begin, end - begin);
+}
+
+std::uint64_t ArenaSequence::hash() const noexcept {
+  std::uint64_t h = reinterpret_cast<std::uintptr_t>(m_values) * 0x9e3779b97f4a7c15ULL;
+  return (h * 0x100000001b3ULL) ^ m_count;
+}
+
+bool ArenaSequence::same(const Sequence & other) const noexcept {
+  const ArenaSequence * view = dynamic_cast<const ArenaSequence *>(&other);
+  return view && m_values == view->m_values && m_count == view->m_count;
+}
+
+bool process_map_supported() noexcept {
+#ifdef PROCESS_MAP_POSIX
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool in_map_worker() noexcept {
+  return map_worker;
+}
+
+#ifdef PROCESS_MAP_POSIX
+
+// the body of a worker process, never returns
+static void run_chunk(const ChunkWork & work, std::size_t begin, std::size_t end, ChunkHeader & header, double * values) {
+
+  std::uint64_t count = 0;
+  try {
+    work(begin, end, [&count, values, begin](const Expression & value) {
+      if (!value.isHeadNumber()) {
+        throw NotNumeric();
+      }
+      values[begin + count++] = value.head().asNumber();
+    });
+    header.count = count;
+    header.status = ChunkDone;
+  }
+  catch (NotNumeric &) {
+    header.status = ChunkNotNumeric;
+  }
+  catch (MapWorkerFallback &) {
+    header.status = ChunkNotNumeric;
+  }
+  catch (std::exception & e) {
+    std::strncpy(header.message, e.what(), sizeof(header.message) - 1);
+    header.status = ChunkFailed;
+  }
+  catch (...) {
+    std::strncpy(header.message, "Error during evaluation: unknown error in map worker", sizeof(header.message) - 1);
+    header.status = ChunkFailed;
+  }
+  // skip destructors and atexit handlers, they belong to the parent
+  _exit(0);
+}
+
+// wait for every worker, killing them all if the kernel is interrupted;
+// returns false if some worker did not exit normally
+static bool reap(std::vector<pid_t> & workers) {
+
+  bool clean = true;
+  std::size_t left = workers.size();
+  while (left > 0) {
+    if (cancellation_requested()) {
+      for (pid_t pid : workers) {
+        if (pid > 0) kill(pid, SIGKILL);
+      }
+    }
+    bool progress = false;
+    for (pid_t & pid : workers) {
+      if (pid <= 0) continue;
+      int status = 0;
+      pid_t done = waitpid(pid, &status, WNOHANG);
+      if (done == pid || (done < 0 && errno != EINTR)) {
+        clean = clean && done == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        pid = 0;
+        --left;
+        progress = true;
+      }
+    }
+    if (!progress && left > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  return clean;
+}
+
+bool process_map(std::size_t size, unsigned processes, const ChunkWork & work, Expression & result) {
+
+  std::size_t chunks = std::max<std::size_t>(1, std::min<std::size_t>(size, processes));
+  std::size_t headers = chunks * sizeof(ChunkHeader);
+  std::shared_ptr<SharedArena> arena = std::make_shared<SharedArena>(headers + std::max<std::size_t>(1, size) * sizeof(double));
+  ChunkHeader * header = reinterpret_cast<ChunkHeader *>(arena->data());
+  double * values = reinterpret_cast<double *>(arena->data() + headers);
+
+  std::vector<pid_t> workers;
+  for (std::size_t c = 0; c < chunks; c++) {
+    std::size_t begin = size * c / chunks;
+    std::size_t end = size * (c + 1) / chunks;
+    pid_t pid = fork();
+    if (pid == 0) {
+      map_worker = true;
+      run_chunk(work, begin, end, header[c], values);
+    }
+    if (pid < 0) {
+      for (pid_t started : workers) kill(started, SIGKILL);
+      reap(workers);
+      throw SemanticError("Error during evaluation: could not start map worker process");
+    }
+    workers.push_back(pid);
+  }
+
+  bool clean = reap(workers);
+  if (cancellation_requested()) {
+    throw SemanticError("Error: interpreter kernel interrupted");
+  }
+  if (!clean) {
+    throw SemanticError("Error during evaluation: map worker process terminated abnormally");
+  }
+
+  bool numeric = true;
+  for (std::size_t c = 0; c < chunks; c++) {
+    if (header[c].status == ChunkFailed) {
+      throw SemanticError(header[c].message);
+    }
+    if (header[c].status != ChunkDone) {
+      numeric = false;
+    }
+  }
+  if (!numeric) {
+    return false;
+  }
+
+  // close the gaps a filter left between chunks, the values stay in the arena
+  std::size_t total = 0;
+  for (std::size_t c = 0; c < chunks; c++) {
+    std::size_t begin = size * c / chunks;
+    std::memmove(values + total, values + begin, header[c].count * sizeof(double));
+    total += header[c].count;
+  }
+  result = Expression::fromSequence(std::make_shared<ArenaSequence>(arena, values, total));
+  return true;
+}
+
+#else
+
+bool process_map(std::size_t, unsigned, const ChunkWork &, Expression &) {
+  return false;
+}
+
+#endif
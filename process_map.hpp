@@ -0,0 +1,105 @@
+/*! \file process_map.hpp
+Defines the process-based backend of parallel map: chunks of a list are
+mapped in forked worker processes that write numeric results straight into
+a shared memory arena, which the parent then uses as the result list.
+ */
+#ifndef PROCESS_MAP_HPP
+#define PROCESS_MAP_HPP
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+#include "sequence.hpp"
+#include "expression.hpp"
+
+/*! \class SharedArena
+\brief A block of anonymous memory shared with forked child processes.
+ */
+class SharedArena {
+public:
+
+  /// map bytes of zeroed shared memory
+  /// \throws SemanticError if the memory can not be mapped
+  explicit SharedArena(std::size_t bytes);
+
+  /// unmap the memory
+  ~SharedArena();
+
+  SharedArena(const SharedArena &) = delete;
+  SharedArena & operator=(const SharedArena &) = delete;
+
+  /// the start of the memory
+  char * data() const noexcept;
+
+  /// the size of the memory in bytes
+  std::size_t size() const noexcept;
+
+private:
+  char * m_data;
+  std::size_t m_size;
+};
+
+/*! \class ArenaSequence
+\brief Numbers stored packed in a SharedArena, viewed as a list.
+
+The sequence keeps the arena alive, so a list adopted from worker processes
+stays valid for as long as any expression refers to it.
+ */
+class ArenaSequence: public Sequence {
+public:
+
+  /// Construct a view of count doubles starting at values inside arena
+  ArenaSequence(const std::shared_ptr<const SharedArena> & arena, const double * values, std::size_t count);
+
+  std::size_t size() const noexcept;
+
+  Expression at(std::size_t i) const noexcept;
+
+  std::shared_ptr<const Sequence> slice(std::size_t begin, std::size_t end) const;
+
+  std::uint64_t hash() const noexcept;
+
+  bool same(const Sequence & other) const noexcept;
+
+private:
+  std::shared_ptr<const SharedArena> m_arena;
+  const double * m_values;
+  std::size_t m_count;
+};
+
+/// the work of one chunk: push the results for elements [begin, end) to sink
+typedef std::function<void(std::size_t begin, std::size_t end,
+  const std::function<void(const Expression &)> & sink)> ChunkWork;
+
+/// true if this platform can fork worker processes
+bool process_map_supported() noexcept;
+
+/*! true in a worker process forked by process_map. The worker has only the
+  thread that forked it, and a lock another thread of the parent held at the
+  fork stays held there forever, so a worker must not use the thread pool or
+  state shared with the parent's threads.
+ */
+bool in_map_worker() noexcept;
+
+/*! \class MapWorkerFallback
+\brief Thrown by work a worker process cannot do, such as waiting for a task
+of the parent's thread pool; the parent then maps the list on threads.
+ */
+struct MapWorkerFallback {};
+
+/*! Run work over [0, size) split into chunks, each in its own process
+  \param size the number of source elements
+  \param processes the number of worker processes, at most one per element
+  \param work maps one chunk, it may produce fewer results than elements;
+  it runs in a forked process and so must not take a lock another thread
+  could hold, see in_map_worker
+  \param result set to a list backed by the shared arena on success
+  \return false, leaving result alone, if some result was not a number or
+  some worker threw MapWorkerFallback
+  \throws SemanticError with the first error of a worker, when a worker
+  process dies, or when the calling evaluation is cancelled
+*/
+bool process_map(std::size_t size, unsigned processes, const ChunkWork & work, Expression & result);
+
+#endif
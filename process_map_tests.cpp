@@ -0,0 +1,106 @@
+#include "catch.hpp"
+
+#include <string>
+#include <sstream>
+#include <csignal>
+
+#include "interpreter.hpp"
+#include "expression.hpp"
+#include "semantic_error.hpp"
+#include "process_map.hpp"
+
+// evaluate program with the process backend on
+static Expression run_forked(const std::string & program) {
+	Interpreter interp;
+	interp.setProcessParallel(true);
+	std::istringstream iss(program);
+	REQUIRE(interp.parseStream(iss));
+	return interp.evaluate();
+}
+
+TEST_CASE("Test process map adopts numeric results", "[process_map]") {
+	if (!process_map_supported()) return;
+
+	ChunkWork square = [](std::size_t begin, std::size_t end, const std::function<void(const Expression &)> & sink) {
+		for (std::size_t i = begin; i < end; i++) {
+			sink(Expression(double(i * i)));
+		}
+	};
+	Expression result;
+	REQUIRE(process_map(100, 3, square, result));
+	REQUIRE(result.isHeadList());
+	REQUIRE(result.isLazy());
+	REQUIRE(result.tailSize() == 100);
+	REQUIRE(result.tailAt(0) == Expression(0.));
+	REQUIRE(result.tailAt(99) == Expression(9801.));
+
+	// the adopted list outlives everything but itself
+	Expression part = Expression::fromSequence(result.sequence()->slice(10, 12));
+	result = Expression();
+	std::vector<Expression> expected = { Expression(100.), Expression(121.) };
+	REQUIRE(part == Expression(expected));
+}
+
+TEST_CASE("Test process map reports non-numeric results and errors", "[process_map]") {
+	if (!process_map_supported()) return;
+
+	ChunkWork symbols = [](std::size_t, std::size_t, const std::function<void(const Expression &)> & sink) {
+		sink(Expression(Atom("x")));
+	};
+	Expression result;
+	REQUIRE_FALSE(process_map(4, 2, symbols, result));
+
+	ChunkWork fails = [](std::size_t begin, std::size_t, const std::function<void(const Expression &)> &) {
+		if (begin > 0) throw SemanticError("Error during evaluation: chunk failed");
+	};
+	REQUIRE_THROWS_WITH(process_map(4, 2, fails, result), "Error during evaluation: chunk failed");
+
+	// a worker dying does not take the interpreter with it, SIGKILL because
+	// the test framework would catch an abort in the worker
+	ChunkWork crashes = [](std::size_t, std::size_t, const std::function<void(const Expression &)> &) {
+		std::raise(SIGKILL);
+	};
+	REQUIRE_THROWS_AS(process_map(4, 2, crashes, result), SemanticError);
+}
+
+TEST_CASE("Test pmap in worker processes", "[process_map]") {
+	if (!process_map_supported()) return;
+
+	Expression result = run_forked("(begin (define f (lambda (x) (* x 2))) (define big (lambda (x) (- x 50))) (pmap f (filter big (range 1 100 1))))");
+	REQUIRE(result.tailSize() == 99);
+	REQUIRE(result.tailAt(0) == Expression(2.));
+	REQUIRE(result.tailAt(48) == Expression(98.));
+	REQUIRE(result.tailAt(49) == Expression(102.));
+
+	// non-numeric results fall back to threads
+	Expression lists = run_forked("(begin (define f (lambda (x) (list x))) (pmap f (list 1 2)))");
+	std::vector<Expression> one = { Expression(1.) };
+	std::vector<Expression> two = { Expression(2.) };
+	std::vector<Expression> expected = { Expression(one), Expression(two) };
+	REQUIRE(lists == Expression(expected));
+
+	REQUIRE_THROWS_AS(run_forked("(begin (define f (lambda (x) (first x))) (pmap f (range 1 10 1)))"), SemanticError);
+}
+
+TEST_CASE("Test spawn, await and pmap inside worker processes", "[process_map]") {
+	if (!process_map_supported()) return;
+
+	REQUIRE_FALSE(in_map_worker());
+
+	// a worker has no pool, so its spawns are evaluated at once
+	Expression spawned = run_forked("(begin (define f (lambda (x) (* x x))) (define g (lambda (x) (await (spawn (f x))))) (pmap g (range 1 8 1)))");
+	REQUIRE(spawned.isLazy());
+	REQUIRE(spawned.tailSize() == 8);
+	REQUIRE(spawned.tailAt(7) == Expression(64.));
+
+	// and its maps run sequentially
+	Expression nested = run_forked("(begin (define f (lambda (x) (* x 2))) (define g (lambda (x) (first (pmap f (list x x))))) (pmap g (range 1 4 1)))");
+	REQUIRE(nested.isLazy());
+	REQUIRE(nested.tailAt(3) == Expression(8.));
+
+	// a future of the parent is left to the parent, which maps on threads
+	Expression awaited = run_forked("(begin (define p (spawn 5)) (define g (lambda (x) (+ x (await p)))) (pmap g (range 1 4 1)))");
+	REQUIRE_FALSE(awaited.isLazy());
+	std::vector<Expression> expected = { Expression(6.), Expression(7.), Expression(8.), Expression(9.) };
+	REQUIRE(awaited == Expression(expected));
+}
@@ -0,0 +1,214 @@
+#include "purity.hpp"
+
+#include <map>
+#include <set>
+#include <string>
+
+#include "expression.hpp"
+#include "environment.hpp"
+
+// the special-forms that take their arguments unevaluated, a body using any
+// other symbol in call position calls a procedure or lambda
+static const std::set<std::string> special_forms = {
+  "begin", "define", "lambda", "apply", "map", "pmap", "filter", "foldl",
+  "foldr", "reduce", "set-property", "get-property", "discrete-plot",
+  "for", "do", "fold-range", "memoize", "spawn", "await"
+};
+
+namespace {
+
+// walks a body tracking the symbols bound inside it. The lambdas it reads
+// are walked again in env, the purity they cached when they were made goes
+// stale once a symbol they read is redefined. visited holds the names of
+// the lambdas being walked, so recursion ends. When reads is given every
+// symbol looked up in env is added to it.
+class PurityWalk {
+public:
+  PurityWalk(const Environment & env, std::set<std::string> & visited, std::set<std::string> * reads = nullptr):
+    m_env(env), m_result(Pure), m_visited(visited), m_reads(reads) {}
+
+  Purity result() const { return m_result; }
+
+  void bind(const Atom & symbol) {
+    if (symbol.isSymbol()) {
+      m_locals.insert(symbol.asSymbol());
+    }
+  }
+
+  void walk(const Expression & exp) {
+    // no need to look further once nothing can be proven, unless the
+    // symbols read are wanted
+    if (m_result == SideEffecting && !m_reads) {
+      return;
+    }
+    // literals and lazy lists can not refer to anything
+    if (exp.isLazy() || !exp.isHeadSymbol()) {
+      walk_tail(exp);
+      return;
+    }
+
+    const std::string & name = exp.head().asSymbol();
+    if (special_forms.count(name) > 0 && exp.tailSize() > 0) {
+      walk_form(name, exp);
+      return;
+    }
+    symbol(exp.head());
+    walk_tail(exp);
+  }
+
+  // the purity of calling lambda, its parameters bound
+  Purity walk_lambda(const Expression & lambda) {
+    if (lambda.tailSize() != 2) {
+      return SideEffecting;
+    }
+    PurityWalk inner(m_env, m_visited, m_reads);
+    Expression params = lambda.tailAt(0);
+    for (auto e = params.tailConstBegin(); e != params.tailConstEnd(); ++e) {
+      inner.bind(e->head());
+    }
+    inner.walk(lambda.tailAt(1));
+    return inner.result();
+  }
+
+private:
+
+  void walk_tail(const Expression & exp) {
+    for (auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); ++e) {
+      walk(*e);
+    }
+  }
+
+  // walk the tail of a binding list, (sym a b ...) binds sym and uses a b
+  void walk_binding(const Expression & binding) {
+    bind(binding.head());
+    walk_tail(binding);
+  }
+
+  void walk_form(const std::string & name, const Expression & exp) {
+    if (name == "define") {
+      raise(SideEffecting);
+      walk_tail(exp);
+    }
+    else if (name == "lambda" && exp.tailSize() == 2) {
+      // the parameters of a nested lambda are bound only within it, so
+      // walk it separately and keep what it depends on
+      PurityWalk inner(*this);
+      Expression params = exp.tailAt(0);
+      inner.bind(params.head());
+      for (auto e = params.tailConstBegin(); e != params.tailConstEnd(); ++e) {
+        inner.bind(e->head());
+      }
+      inner.walk(exp.tailAt(1));
+      raise(inner.result());
+    }
+    else if (name == "for" && exp.tailSize() == 2) {
+      walk_binding(exp.tailAt(0));
+      walk(exp.tailAt(1));
+    }
+    else if (name == "do" && exp.tailSize() == 3) {
+      walk_binding(exp.tailAt(0));
+      walk_binding(exp.tailAt(1));
+      walk(exp.tailAt(2));
+    }
+    else {
+      walk_tail(exp);
+    }
+  }
+
+  // a symbol used in the body, either bound inside it or looked up. The
+  // builtin constants never change, unless a definition hides them.
+  void symbol(const Atom & sym) {
+    const std::string & name = sym.asSymbol();
+    if (m_locals.count(name) > 0 || m_env.is_proc(sym) || m_env.is_builtin_exp(sym)) {
+      return;
+    }
+    if (m_reads) {
+      m_reads->insert(name);
+    }
+    if (m_visited.count(name) > 0) {
+      // a lambda already being walked, what it reads is counted there
+      raise(ReadsGlobals);
+      return;
+    }
+    if (!m_env.is_exp(sym)) {
+      // may be defined later as anything
+      raise(SideEffecting);
+      return;
+    }
+    raise(ReadsGlobals);
+    Expression value = m_env.get_exp(sym);
+    // a pure lambda reads no symbol, so its cached purity can not be stale
+    if (value.isHeadLambda() && value.purity() != Pure) {
+      m_visited.insert(name);
+      raise(walk_lambda(value));
+    }
+  }
+
+
+  void raise(Purity p) {
+    if (p > m_result) {
+      m_result = p;
+    }
+  }
+
+  const Environment & m_env;
+  Purity m_result;
+  std::set<std::string> m_locals;
+  std::set<std::string> & m_visited;
+  std::set<std::string> * m_reads;
+};
+
+}
+
+Purity classify_lambda(const Expression & lambda, const Environment & env, const std::string & self) {
+
+  std::set<std::string> visited;
+  if (!self.empty()) {
+    visited.insert(self);
+  }
+  PurityWalk walk(env, visited);
+  return walk.walk_lambda(lambda);
+}
+
+std::vector<std::string> lambda_reads(const Expression & lambda) {
+
+  // no symbol is bound in an environment without definitions, so the walk
+  // records what the body looks up without following it into other lambdas
+  static const Environment builtins_only;
+  std::set<std::string> visited;
+  std::set<std::string> reads;
+  PurityWalk walk(builtins_only, visited, &reads);
+  walk.walk_lambda(lambda);
+  return std::vector<std::string>(reads.begin(), reads.end());
+}
+
+std::map<std::string, Expression> global_reads(const Expression & lambda, const Environment & env) {
+
+  std::map<std::string, Expression> reads;
+  std::vector<std::string> pending = lambda.reads();
+  while (!pending.empty()) {
+    std::string name = pending.back();
+    pending.pop_back();
+    if (reads.count(name) > 0) {
+      continue;
+    }
+    Atom symbol(name);
+    Expression & value = reads[name];
+    if (env.is_exp(symbol)) {
+      value = env.get_exp(symbol);
+    }
+    // a pure lambda reads nothing
+    if (value.isHeadLambda() && value.purity() != Pure) {
+      pending.insert(pending.end(), value.reads().begin(), value.reads().end());
+    }
+  }
+  return reads;
+}
+
+Purity classify_expression(const Expression & exp, const Environment & env) {
+
+  std::set<std::string> visited;
+  PurityWalk walk(env, visited);
+  walk.walk(exp);
+  return walk.result();
+}
@@ -0,0 +1,66 @@
+/*! \file purity.hpp
+Defines the purity classification of user lambdas, used by the evaluator to
+decide when a call may be run in parallel or memoized.
+ */
+#ifndef PURITY_HPP
+#define PURITY_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+// forward declare Expression and Environment
+class Expression;
+class Environment;
+
+/*! \enum Purity
+\brief What evaluating the body of a lambda may depend on or change.
+
+The kinds are ordered, a lambda calling another lambda is at least as impure
+as the lambda it calls.
+ */
+enum Purity {
+  /// only uses its parameters, literals, builtin procedures and constants
+  Pure,
+  /// also reads symbols bound in the environment the lambda was made in
+  ReadsGlobals,
+  /// defines symbols, or uses symbols whose meaning is not known yet
+  SideEffecting
+};
+
+/*! Classify a lambda built by the lambda special-form. The lambdas it reads
+  are classified again in env rather than trusting the purity they cached.
+  \param lambda the lambda, its tail holds the parameter list and body
+  \param env the environment the lambda is made or called in
+  \param self the name the lambda is being defined as, so a recursive call
+  reads a global rather than a symbol not known yet
+*/
+Purity classify_lambda(const Expression & lambda, const Environment & env,
+  const std::string & self = std::string());
+
+/*! The symbols the body of lambda looks up in the environment it is called
+  in: not its parameters, the symbols bound inside it, or the builtins. They
+  depend only on the lambda, so each lambda caches them when it is made.
+  \param lambda the lambda, its tail holds the parameter list and body
+*/
+std::vector<std::string> lambda_reads(const Expression & lambda);
+
+/*! The symbols a call to lambda reads from the environment it runs in, other
+  than its parameters, including those read by the lambdas it calls as they
+  are bound in env. A result memoized for a call holds only while they keep
+  their values. Follows the reads cached on each lambda without walking any
+  body.
+  \param lambda the lambda, its tail holds the parameter list and body
+  \param env the environment the lambda is called in
+  \return each symbol with its value in env, the empty expression if unbound
+*/
+std::map<std::string, Expression> global_reads(const Expression & lambda, const Environment & env);
+
+/*! Classify an unevaluated expression as if it were the body of a lambda
+  without parameters
+  \param exp the expression
+  \param env the environment it would be evaluated in
+*/
+Purity classify_expression(const Expression & exp, const Environment & env);
+
+#endif
@@ -0,0 +1,128 @@
+#include "catch.hpp"
+
+#include <string>
+#include <sstream>
+
+#include "interpreter.hpp"
+#include "expression.hpp"
+#include "environment.hpp"
+#include "token.hpp"
+#include "parse.hpp"
+#include "purity.hpp"
+
+// the purity of the lambda a program evaluates to
+static Purity lambda_purity(const std::string & program) {
+	Interpreter interp;
+	std::istringstream iss(program);
+	REQUIRE(interp.parseStream(iss));
+	Expression result = interp.evaluate();
+	REQUIRE(result.isHeadLambda());
+	return result.purity();
+}
+
+TEST_CASE("Test lambdas using only parameters and builtins are pure", "[purity]") {
+	std::vector<std::string> programs = {
+		"(lambda (x) (+ x 1))",
+		"(lambda (x y) (list (* x y) (sqrt x)))",
+		"(lambda (x) (map sqrt (list x x)))",
+		"(lambda (x) (apply (lambda (y) (* y x)) (list 2)))",
+		"(lambda (n) (for (i 1 n 1) (* i i)))",
+		"(lambda (n) (do (acc 0) (i 1 n 1) (+ acc i)))",
+		"(begin (define sq (lambda (x) (* x x))) (lambda (y) (sq y)))" };
+	for (auto s : programs) {
+		INFO(s);
+		if (s.find("define") == std::string::npos) {
+			REQUIRE(lambda_purity(s) == Pure);
+		}
+		else {
+			// calling a pure lambda still reads the global naming it
+			REQUIRE(lambda_purity(s) == ReadsGlobals);
+		}
+	}
+}
+
+TEST_CASE("Test lambdas reading globals", "[purity]") {
+	REQUIRE(lambda_purity("(begin (define a 2) (lambda (x) (* a x)))") == ReadsGlobals);
+}
+
+TEST_CASE("Test builtin constants are pure unless hidden", "[purity]") {
+	REQUIRE(lambda_purity("(lambda (x) (* pi x))") == Pure);
+	REQUIRE(lambda_purity("(lambda (x) (list e I x))") == Pure);
+
+	Environment env;
+	std::istringstream iss("(lambda (x) (* pi x))");
+	Expression lambda = parse(tokenize(iss)).eval(env);
+	env.add_exp(Atom("pi"), Expression(3.));
+	REQUIRE(classify_lambda(lambda, env) == ReadsGlobals);
+}
+
+TEST_CASE("Test side-effecting lambdas", "[purity]") {
+	// defines into its environment
+	REQUIRE(lambda_purity("(lambda (x) (begin (define b x) b))") == SideEffecting);
+	// uses a symbol that is not defined yet
+	REQUIRE(lambda_purity("(lambda (x) (g x))") == SideEffecting);
+	// calls a side-effecting lambda
+	REQUIRE(lambda_purity("(begin (define f (lambda (x) (define c x))) (lambda (y) (f y)))") == SideEffecting);
+	// a nested lambda does not bind its parameters outside itself
+	REQUIRE(lambda_purity("(lambda (x) (list (lambda (y) y) y))") == SideEffecting);
+}
+
+TEST_CASE("Test a recursive lambda reads its own name", "[purity]") {
+	REQUIRE(lambda_purity("(begin (define f (lambda (n) (f n))) f)") == ReadsGlobals);
+	REQUIRE(lambda_purity("(begin (define f (lambda (n) (f n))) (lambda (x) (f x)))") == ReadsGlobals);
+	// defining under another name keeps the unknown symbol
+	REQUIRE(lambda_purity("(begin (define f (lambda (n) (h n))) f)") == SideEffecting);
+}
+
+TEST_CASE("Test the lambdas read are classified as they are now", "[purity]") {
+	// g read a symbol that was not known yet when it was made
+	REQUIRE(lambda_purity("(begin (define g (lambda (x) (* a x))) (define a 2) (lambda (y) (g y)))") == ReadsGlobals);
+
+	Environment env;
+	auto run = [&env](const std::string & program) {
+		std::istringstream iss(program);
+		return parse(tokenize(iss)).eval(env);
+	};
+	run("(define g (lambda (x) (+ x 1)))");
+	Expression h = run("(define h (lambda (y) (g y)))");
+	REQUIRE(h.purity() == ReadsGlobals);
+	run("(define g (lambda (x) (define c x)))");
+	REQUIRE(classify_lambda(h, env) == SideEffecting);
+}
+
+TEST_CASE("Test purity is kept when a lambda is copied", "[purity]") {
+	Expression lambda = [] {
+		Interpreter interp;
+		std::istringstream iss("(lambda (x) (+ x 1))");
+		REQUIRE(interp.parseStream(iss));
+		return interp.evaluate();
+	}();
+	Expression copy(lambda);
+	REQUIRE(copy.purity() == Pure);
+	Expression assigned;
+	assigned = lambda;
+	REQUIRE(assigned.purity() == Pure);
+	REQUIRE(Expression(Atom(1.)).purity() == SideEffecting);
+}
+
+TEST_CASE("Test the symbols a lambda reads are cached when it is made", "[purity]") {
+	Environment env;
+	auto run = [&env](const std::string & program) {
+		std::istringstream iss(program);
+		return parse(tokenize(iss)).eval(env);
+	};
+	Expression f = run("(define f (lambda (x) (+ a (g x) pi (apply (lambda (y) (* y c)) (list x)))))");
+	std::vector<std::string> direct = { "a", "c", "g" };
+	REQUIRE(f.reads() == direct);
+	REQUIRE(Expression(f).reads() == direct);
+	REQUIRE(run("(lambda (x) (* x x))").reads().empty());
+
+	// what the lambdas it calls read is followed as they are bound now
+	run("(define g (lambda (x) (* b x)))");
+	run("(define b 2)");
+	std::map<std::string, Expression> reads = global_reads(f, env);
+	REQUIRE(reads.size() == 4);
+	REQUIRE(reads["b"] == Expression(2.));
+	REQUIRE(reads["a"] == Expression());
+	REQUIRE(reads["g"].isHeadLambda());
+}
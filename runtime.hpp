@@ -0,0 +1,102 @@
+/*! \file runtime.hpp
+Defines the state belonging to one interpreter that is shared by every
+environment derived from its global environment.
+ */
+#ifndef RUNTIME_HPP
+#define RUNTIME_HPP
+
+#include <atomic>
+
+#include "memo.hpp"
+#include "interner.hpp"
+#include "budget.hpp"
+
+/*! \class Runtime
+\brief Per-interpreter caches and evaluation settings.
+
+Copies of an Environment, such as the frames lambdas are called in, share the
+Runtime of the environment they were copied from.
+ */
+class Runtime {
+public:
+
+  /// Construct with an empty memo cache, automatic memoization,
+  /// hash-consing, parallel arguments and process parallelism off
+  Runtime(): m_autoMemoize(false), m_hashConsing(false), m_parallelArguments(false), m_processParallel(false),
+    m_maxSteps(0), m_maxMilliseconds(0), m_maxBytes(0) {}
+
+  Runtime(const Runtime &) = delete;
+  Runtime & operator=(const Runtime &) = delete;
+
+  /// take the settings, limits and memo capacity of other, keeping the
+  /// caches of this runtime
+  void copySettings(const Runtime & other) {
+    m_memo.setCapacity(other.m_memo.capacity());
+    m_autoMemoize = other.autoMemoize();
+    m_hashConsing = other.hashConsing();
+    m_parallelArguments = other.parallelArguments();
+    m_processParallel = other.processParallel();
+    setLimits(other.limits());
+  }
+
+  /// the cache of memoized lambda results
+  MemoCache & memo() { return m_memo; }
+
+  /// true if calls to pure lambdas are memoized without being asked to
+  bool autoMemoize() const { return m_autoMemoize; }
+
+  /// turn automatic memoization of pure lambdas on or off
+  void setAutoMemoize(bool on) { m_autoMemoize = on; }
+
+  /// the table of shared property maps
+  PropertyInterner & interner() { return m_interner; }
+
+  /// true if set-property shares identical property maps
+  bool hashConsing() const { return m_hashConsing; }
+
+  /// turn sharing of identical property maps on or off
+  void setHashConsing(bool on) { m_hashConsing = on; }
+
+  /// true if expensive arguments of a procedure call may be evaluated on
+  /// the thread pool
+  bool parallelArguments() const { return m_parallelArguments; }
+
+  /// turn parallel evaluation of procedure arguments on or off
+  void setParallelArguments(bool on) { m_parallelArguments = on; }
+
+  /// true if parallel maps run their chunks in forked worker processes
+  bool processParallel() const { return m_processParallel; }
+
+  /// choose forked worker processes or the thread pool for parallel maps
+  void setProcessParallel(bool on) { m_processParallel = on; }
+
+  /// the limits of each evaluation started through an Interpreter
+  Limits limits() const {
+    Limits limits;
+    limits.steps = m_maxSteps;
+    limits.milliseconds = m_maxMilliseconds;
+    limits.bytes = m_maxBytes;
+    return limits;
+  }
+
+  /// change the limits of evaluations started from now on
+  void setLimits(const Limits & limits) {
+    m_maxSteps = limits.steps;
+    m_maxMilliseconds = limits.milliseconds;
+    m_maxBytes = limits.bytes;
+  }
+
+private:
+
+  MemoCache m_memo;
+  PropertyInterner m_interner;
+  std::atomic<bool> m_autoMemoize;
+  std::atomic<bool> m_hashConsing;
+  std::atomic<bool> m_parallelArguments;
+  std::atomic<bool> m_processParallel;
+  std::atomic<std::uint64_t> m_maxSteps;
+  std::atomic<std::uint64_t> m_maxMilliseconds;
+  std::atomic<std::uint64_t> m_maxBytes;
+};
+
+#endif
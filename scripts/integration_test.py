@@ -2,6 +2,11 @@ import pexpect
 import pexpect.replwrap as replwrap
 import unittest
 import os
+import tempfile
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from serve_client import Client
         
 # the plotscript executable
 cmd = './plotscript'
@@ -40,6 +45,43 @@ class TestREPL(unittest.TestCase):
                 output = self.wrapper.run_command(u'(define begin True)')
                 self.assertTrue(output.strip().startswith('Error'))
                                 
+class TestPipelinedREPL(unittest.TestCase):
+
+        def test_tagged_results(self):
+                child = pexpect.spawn(cmd + ' --pipeline')
+                child.sendline(u'(+ 1 2)')
+                child.sendline(u'(+ 1 a)')
+                child.sendline(u'%wait')
+                child.expect(r'\[1\] \(3\)')
+                child.expect(r'\[2\] Error')
+                child.sendline(u'%status')
+                child.expect(u'0 in flight, 2 of 2 finished')
+                child.sendline(u'%exit')
+                child.expect(pexpect.EOF)
+
+        def test_checkpoint(self):
+                child = pexpect.spawn(cmd + ' --pipeline')
+                child.sendline(u'(define a 1)')
+                child.sendline(u'%checkpoint one')
+                child.sendline(u'(define a 2)')
+                child.sendline(u'%restore one')
+                child.sendline(u'(+ a 0)')
+                child.expect(r'\[2\] Info: saved checkpoint one')
+                child.expect(r'\[4\] Info: restored checkpoint one')
+                child.expect(r'\[5\] \(1\)')
+                child.sendline(u'%exit')
+                child.expect(pexpect.EOF)
+
+        def test_cancel_one(self):
+                child = pexpect.spawn(cmd + ' --pipeline')
+                child.sendline(u'(begin (define f (lambda (a x) (+ a x))) (fold-range f 0 0 1e9 1))')
+                child.sendline(u'(+ 2 2)')
+                child.sendline(u'%cancel 1')
+                child.expect(r'\[1\] Error: interpreter kernel interrupted')
+                child.expect(r'\[2\] \(4\)')
+                child.sendline(u'%exit')
+                child.expect(pexpect.EOF)
+                                
 class TestExecuteCommandline(unittest.TestCase):
                 
         def test_sub(self):
@@ -54,6 +96,12 @@ class TestExecuteCommandline(unittest.TestCase):
                 self.assertNotEqual(retcode, 0)
                 self.assertTrue(output.strip().startswith(b'Error'))
 
+        def test_processes(self):
+                args = ' --processes -e ' + ' "(begin (define f (lambda (x) (* x x))) (define g (lambda (x) (await (spawn (f x))))) (list (first (pmap f (range 1 8 1))) (first (pmap g (range 1 8 1)))))" '
+                (output, retcode) = pexpect.run(cmd+args, withexitstatus=True, extra_args=args)
+                self.assertEqual(retcode, 0)
+                self.assertEqual(output.strip(), b"((1) (1))")
+
 class TestExecuteFromFile(unittest.TestCase):
                 
         def test_unix(self):
@@ -74,5 +122,42 @@ class TestExecuteFromFile(unittest.TestCase):
                 self.assertNotEqual(retcode, 0)
                 self.assertTrue(output.strip().startswith(b'Error'))
 
+class TestBatch(unittest.TestCase):
+
+        def test_outputs_and_summary(self):
+                directory = tempfile.mkdtemp()
+                good = os.path.join(directory, 'good.pls')
+                bad = os.path.join(directory, 'bad.pls')
+                with open(good, 'w') as f:
+                        f.write('(+ 1 2)')
+                with open(bad, 'w') as f:
+                        f.write('(+ 1 a)')
+                args = ' --batch -j 2 ' + good + ' ' + bad
+                (output, retcode) = pexpect.run(cmd+args, withexitstatus=True, extra_args=args)
+                self.assertNotEqual(retcode, 0)
+                self.assertIn(b'2 files, 1 failed', output)
+                with open(good + '.out') as f:
+                        self.assertEqual(f.read().strip(), '(3)')
+                with open(bad + '.out') as f:
+                        self.assertTrue(f.read().startswith('Error'))
+
+class TestServe(unittest.TestCase):
+
+        def test_sessions(self):
+                path = os.path.join(tempfile.mkdtemp(), 'plotscript.sock')
+                server = pexpect.spawn(cmd + ' --serve ' + path)
+                server.expect('serving on')
+                client = Client(path)
+                self.assertEqual(client.request('(+ 1 2)'), (True, '(3)'))
+                self.assertEqual(client.request('(define x\n  4)', 'work'), (True, '(4)'))
+                self.assertEqual(client.request('(* x x)', 'work'), (True, '(16)'))
+                (ok, output) = client.request('(* x x)')
+                self.assertFalse(ok)
+                self.assertTrue(output.startswith('Error'))
+                client.close()
+                server.sendintr()
+                server.expect('stopped serving')
+                server.expect(pexpect.EOF)
+
 # run the tests
 unittest.main()
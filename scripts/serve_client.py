@@ -0,0 +1,37 @@
+"""A small client for plotscript --serve.
+
+    python3 serve_client.py SOCKET [SESSION] < program.pls
+
+sends the program on standard input to SESSION, - for a fresh session by
+default, and prints the result. The exit status is 1 on an error reply.
+"""
+import socket
+import sys
+
+class Client:
+
+        def __init__(self, path):
+                self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+                self.sock.connect(path)
+                self.reader = self.sock.makefile('rb')
+
+        def request(self, program, session='-'):
+                """Evaluate program on session, returning (ok, output)."""
+                body = program.encode()
+                self.sock.sendall(session.encode() + b' #' + str(len(body)).encode() + b'\n' + body)
+                status, length = self.reader.readline().split()
+                output = self.reader.read(int(length) + 1)[:-1]
+                return (status == b'ok', output.decode())
+
+        def close(self):
+                self.reader.close()
+                self.sock.close()
+
+if __name__ == '__main__':
+        if len(sys.argv) not in (2, 3):
+                sys.exit(__doc__)
+        client = Client(sys.argv[1])
+        (ok, output) = client.request(sys.stdin.read(), sys.argv[2] if len(sys.argv) == 3 else '-')
+        client.close()
+        print(output)
+        sys.exit(0 if ok else 1)
@@ -0,0 +1,64 @@
+#include "sequence.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "expression.hpp"
+#include "semantic_error.hpp"
+
+RangeSequence::RangeSequence(double start, double step, std::size_t count):
+  m_start(start), m_step(step), m_count(count) {}
+
+std::shared_ptr<const Sequence> RangeSequence::make(double begin, double end, double step) {
+
+  return std::make_shared<RangeSequence>(begin, step, count(begin, end, step));
+}
+
+std::size_t RangeSequence::count(double begin, double end, double step) {
+
+  // count the elements without stepping through them, the guard catches
+  // the last element being lost to rounding in the division. Converting a
+  // number that does not fit a size_t is undefined, so it is checked first.
+  double steps = std::floor((end - begin) / step);
+  if (!std::isfinite(steps) || steps < 0 || steps >= static_cast<double>(std::numeric_limits<std::size_t>::max())) {
+    throw SemanticError("Error: too many elements in range.");
+  }
+  std::size_t count = static_cast<std::size_t>(steps) + 1;
+  if (begin + count * step <= end) {
+    count++;
+  }
+  return count;
+}
+
+std::size_t RangeSequence::size() const noexcept {
+  return m_count;
+}
+
+Expression RangeSequence::at(std::size_t i) const noexcept {
+  return Expression(m_start + i * m_step);
+}
+
+std::shared_ptr<const Sequence> RangeSequence::slice(std::size_t begin, std::size_t end) const {
+  if (end > m_count) end = m_count;
+  if (begin > end) begin = end;
+  return std::make_shared<RangeSequence>(m_start + begin * m_step, m_step, end - begin);
+}
+
+// the bits of a number, so ranges hash and compare exactly
+static std::uint64_t bits(double d) noexcept {
+  std::uint64_t result;
+  std::memcpy(&result, &d, sizeof(result));
+  return result;
+}
+
+std::uint64_t RangeSequence::hash() const noexcept {
+  std::uint64_t h = (bits(m_start) * 0x9e3779b97f4a7c15ULL) ^ bits(m_step);
+  return (h * 0x100000001b3ULL) ^ m_count;
+}
+
+bool RangeSequence::same(const Sequence & other) const noexcept {
+  const RangeSequence * range = dynamic_cast<const RangeSequence *>(&other);
+  return range && bits(m_start) == bits(range->m_start) && bits(m_step) == bits(range->m_step) &&
+    m_count == range->m_count;
+}
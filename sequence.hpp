@@ -0,0 +1,78 @@
+/*! \file sequence.hpp
+Defines the Sequence type used to represent lists whose elements are
+produced on demand rather than stored.
+ */
+#ifndef SEQUENCE_HPP
+#define SEQUENCE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// forward declare Expression
+class Expression;
+
+/*! \class Sequence
+\brief An immutable, indexable generator of list elements.
+
+A Sequence knows how many elements it has and can produce any one of them
+without producing the others. Expressions holding a Sequence behave as lists
+and only materialize their elements when the whole tail is needed.
+ */
+class Sequence {
+public:
+
+  virtual ~Sequence() {}
+
+  /// the number of elements in the sequence
+  virtual std::size_t size() const noexcept = 0;
+
+  /// produce the element at index i, i must be less than size()
+  virtual Expression at(std::size_t i) const noexcept = 0;
+
+  /// a sequence of the elements in [begin, end) without producing them
+  virtual std::shared_ptr<const Sequence> slice(std::size_t begin, std::size_t end) const = 0;
+
+  /// a hash of what the sequence describes, equal for sequences that are same()
+  virtual std::uint64_t hash() const noexcept = 0;
+
+  /// true if other describes the same elements in the same way, false when
+  /// that can not be told without producing them
+  virtual bool same(const Sequence & other) const noexcept = 0;
+};
+
+/*! \class RangeSequence
+\brief The numbers start, start + step, ... up to and including end.
+ */
+class RangeSequence: public Sequence {
+public:
+
+  /// Construct the range of count numbers beginning at start
+  RangeSequence(double start, double step, std::size_t count);
+
+  /// Construct the range from begin to end (inclusive) by step, step must be positive
+  /// \throws SemanticError if the range has more elements than a size_t can count
+  static std::shared_ptr<const Sequence> make(double begin, double end, double step);
+
+  /// the number of elements from begin to end (inclusive) by step, element
+  /// k being begin + k * step. Counting loops use it to visit the same values.
+  /// \throws SemanticError if the bounds are not finite or the count does not fit a size_t
+  static std::size_t count(double begin, double end, double step);
+
+  std::size_t size() const noexcept;
+
+  Expression at(std::size_t i) const noexcept;
+
+  std::shared_ptr<const Sequence> slice(std::size_t begin, std::size_t end) const;
+
+  std::uint64_t hash() const noexcept;
+
+  bool same(const Sequence & other) const noexcept;
+
+private:
+  double m_start;
+  double m_step;
+  std::size_t m_count;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#include "catch.hpp"
+
+#include "sequence.hpp"
+#include "expression.hpp"
+
+TEST_CASE("Test range sequence size and elements", "[sequence]") {
+	std::shared_ptr<const Sequence> seq = RangeSequence::make(0, 1, 0.25);
+	REQUIRE(seq->size() == 5);
+	REQUIRE(seq->at(0) == Expression(0.));
+	REQUIRE(seq->at(3) == Expression(0.75));
+	REQUIRE(seq->at(4) == Expression(1.));
+
+	// the end point is kept even when the step does not divide evenly
+	REQUIRE(RangeSequence::make(0, 1, 0.1)->size() == 11);
+	REQUIRE(RangeSequence::make(0, 1, 0.3)->size() == 4);
+}
+
+TEST_CASE("Test range sequence slice", "[sequence]") {
+	std::shared_ptr<const Sequence> seq = RangeSequence::make(1, 10, 1);
+	std::shared_ptr<const Sequence> part = seq->slice(2, 5);
+	REQUIRE(part->size() == 3);
+	REQUIRE(part->at(0) == Expression(3.));
+	REQUIRE(part->at(2) == Expression(5.));
+	REQUIRE(seq->slice(8, 100)->size() == 2);
+	REQUIRE(seq->slice(20, 30)->size() == 0);
+}
+
+TEST_CASE("Test lazy expression materializes on iteration", "[sequence]") {
+	Expression lazy = Expression::fromSequence(RangeSequence::make(1, 3, 1));
+	REQUIRE(lazy.isHeadList());
+	REQUIRE(lazy.isLazy());
+	REQUIRE(lazy.tailSize() == 3);
+	REQUIRE(lazy.tailAt(1) == Expression(2.));
+
+	// copies share the generator until they are iterated
+	Expression copy = lazy;
+	REQUIRE(copy.isLazy());
+
+	std::vector<Expression> expected = { Expression(1.), Expression(2.), Expression(3.) };
+	REQUIRE(lazy == Expression(expected));
+	REQUIRE(!lazy.isLazy());
+	REQUIRE(copy.isLazy());
+}
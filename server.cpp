@@ -0,0 +1,339 @@
+#include "server.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "semantic_error.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SERVER_POSIX
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// the longest program a length-prefixed request may carry
+const std::size_t max_request = std::size_t(64) << 20;
+
+// how often run() looks at the stop flags while waiting for a connection
+const int accept_poll_ms = 100;
+
+#ifdef SERVER_POSIX
+
+// buffered reads of lines and counted bytes from a connected socket
+class Reader {
+public:
+  explicit Reader(int fd): m_fd(fd) {}
+
+  // the next line without its newline, false once the socket closes
+  bool line(std::string & text) {
+    std::size_t end;
+    while ((end = m_buffer.find('\n')) == std::string::npos) {
+      if (!fill()) return false;
+    }
+    text.assign(m_buffer, 0, end);
+    m_buffer.erase(0, end + 1);
+    return true;
+  }
+
+  // exactly count bytes, false if the socket closes first
+  bool bytes(std::size_t count, std::string & text) {
+    while (m_buffer.size() < count) {
+      if (!fill()) return false;
+    }
+    text.assign(m_buffer, 0, count);
+    m_buffer.erase(0, count);
+    return true;
+  }
+
+private:
+  bool fill() {
+    char chunk[4096];
+    ssize_t n;
+    do {
+      n = recv(m_fd, chunk, sizeof(chunk), 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return false;
+    m_buffer.append(chunk, n);
+    return true;
+  }
+
+  int m_fd;
+  std::string m_buffer;
+};
+
+// write all of text, false if the peer has gone
+bool send_all(int fd, const std::string & text) {
+#ifdef MSG_NOSIGNAL
+  const int flags = MSG_NOSIGNAL;
+#else
+  const int flags = 0;
+#endif
+  std::size_t sent = 0;
+  while (sent < text.size()) {
+    ssize_t n = send(fd, text.data() + sent, text.size() - sent, flags);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    sent += n;
+  }
+  return true;
+}
+
+#endif
+
+std::string frame(const ServerReply & reply) {
+  std::ostringstream out;
+  out << (reply.ok ? "ok " : "error ") << reply.output.size() << '\n' << reply.output << '\n';
+  return out.str();
+}
+
+// session names are - or words of letters, digits, -, _ and ., so a
+// program sent without a name is refused rather than run on a session
+bool valid_name(const std::string & name) {
+  return !name.empty() && name.find_first_not_of(
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_.") == std::string::npos;
+}
+
+ServerReply failure(const std::string & message) {
+  ServerReply reply;
+  reply.output = message;
+  return reply;
+}
+
+// parse and evaluate program on interp under token
+ServerReply evaluate(Interpreter & interp, const std::string & program, const CancelToken & token) {
+  ServerReply reply;
+  std::istringstream stream(program);
+  if (!interp.parseStream(stream)) {
+    reply.output = "Error: Invalid Program. Could not parse.";
+    return reply;
+  }
+  try {
+    std::ostringstream out;
+    out << interp.evaluate(token);
+    reply.output = out.str();
+    reply.ok = true;
+  }
+  catch (const SemanticError & ex) {
+    reply.output = ex.what();
+  }
+  catch (const std::exception & ex) {
+    // a request that runs out of memory fails alone rather than ending the server
+    reply.output = std::string("Error: ") + ex.what();
+  }
+  return reply;
+}
+
+}
+
+Server::Server(const Interpreter & startup, std::size_t warm):
+  m_startup(startup), m_warm(warm), m_listener(-1), m_stop(false) {
+  refill();
+}
+
+Server::~Server() {
+  stop();
+#ifdef SERVER_POSIX
+  if (m_listener >= 0) {
+    close(m_listener);
+    unlink(m_path.c_str());
+  }
+#endif
+}
+
+bool Server::supported() noexcept {
+#ifdef SERVER_POSIX
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Server::listen(const std::string & path) {
+#ifdef SERVER_POSIX
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Error: socket path is empty or too long: " + path);
+  }
+  std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+  // only ever remove a socket, never a file that happens to have the name
+  struct stat info;
+  if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+    unlink(path.c_str());
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    throw std::runtime_error(std::string("Error: could not make a socket: ") + std::strerror(errno));
+  }
+  if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 || ::listen(fd, SOMAXCONN) < 0) {
+    int code = errno;
+    close(fd);
+    throw std::runtime_error("Error: could not listen on " + path + ": " + std::strerror(code));
+  }
+  if (m_listener >= 0) {
+    close(m_listener);
+    unlink(m_path.c_str());
+  }
+  m_listener = fd;
+  m_path = path;
+#else
+  throw std::runtime_error("Error: serving on a socket is not supported");
+#endif
+}
+
+void Server::run() {
+#ifdef SERVER_POSIX
+  if (m_listener < 0) {
+    throw std::runtime_error("Error: the server is not listening");
+  }
+  while (!m_stop.load() && global_status_flag == 0) {
+    pollfd waiting = { m_listener, POLLIN, 0 };
+    if (poll(&waiting, 1, accept_poll_ms) <= 0) continue;
+    int fd = accept(m_listener, nullptr, nullptr);
+    if (fd < 0) continue;
+
+    std::lock_guard<std::mutex> lock(m_connections_mutex);
+    m_connections.insert(fd);
+    std::thread(&Server::serve, this, fd).detach();
+  }
+
+  // running requests fail with an interrupted error that is still sent,
+  // then every connection reads end of input and closes
+  m_token.cancel();
+  std::unique_lock<std::mutex> lock(m_connections_mutex);
+  for (int fd : m_connections) {
+    shutdown(fd, SHUT_RD);
+  }
+  m_connections_done.wait(lock, [this] { return m_connections.empty(); });
+  m_token = CancelToken();
+  m_stop.store(false);
+#else
+  throw std::runtime_error("Error: serving on a socket is not supported");
+#endif
+}
+
+void Server::stop() noexcept {
+  m_stop.store(true);
+}
+
+void Server::serve(int fd) {
+#ifdef SERVER_POSIX
+  Reader reader(fd);
+  std::string header;
+  while (reader.line(header)) {
+    ServerReply reply;
+    bool framed = true;
+    std::size_t space = header.find(' ');
+    if (space == std::string::npos || !valid_name(header.substr(0, space))) {
+      reply = failure("Error: request must start with a session name and a space");
+    }
+    else {
+      std::string name = header.substr(0, space);
+      std::string program = header.substr(space + 1);
+      if (program.size() > 1 && program[0] == '#' &&
+          program.find_first_not_of("0123456789", 1) == std::string::npos) {
+        // more digits than any length that fits is simply too long
+        std::size_t length = program.size() > 12 ? max_request + 1 : std::stoull(program.substr(1));
+        if (length > max_request) {
+          // the program cannot be skipped without reading it all, so the
+          // connection closes after the error
+          reply = failure("Error: request longer than " + std::to_string(max_request) + " bytes");
+          framed = false;
+        }
+        else if (!reader.bytes(length, program)) {
+          break;
+        }
+      }
+      if (framed) {
+        reply = handle(name, program);
+      }
+    }
+    if (!send_all(fd, frame(reply)) || !framed) {
+      break;
+    }
+    refill();
+  }
+
+  // forget the descriptor before closing it, accept may reuse the number
+  std::lock_guard<std::mutex> lock(m_connections_mutex);
+  m_connections.erase(fd);
+  close(fd);
+  m_connections_done.notify_all();
+#else
+  (void)fd;
+#endif
+}
+
+ServerReply Server::handle(const std::string & name, const std::string & program) {
+  CancelToken token = m_token;
+
+  if (name == "-") {
+    Interpreter interp = take();
+    return evaluate(interp, program, token);
+  }
+  if (program == "%close") {
+    std::lock_guard<std::mutex> lock(m_sessions_mutex);
+    ServerReply reply;
+    reply.ok = m_sessions.erase(name) > 0;
+    reply.output = reply.ok ? "closed " + name : "Error: no session named " + name;
+    return reply;
+  }
+
+  std::shared_ptr<Session> named = session(name);
+  std::lock_guard<std::mutex> lock(named->mutex);
+  return evaluate(named->interp, program, token);
+}
+
+void Server::refill() {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(m_pool_mutex);
+      if (m_pool.size() >= m_warm) return;
+    }
+    // clone outside the lock so requests can take the clones already made
+    Interpreter copy = m_startup.clone();
+    std::lock_guard<std::mutex> lock(m_pool_mutex);
+    m_pool.push_back(std::move(copy));
+  }
+}
+
+std::size_t Server::sessions() const {
+  std::lock_guard<std::mutex> lock(m_sessions_mutex);
+  return m_sessions.size();
+}
+
+Interpreter Server::take() {
+  {
+    std::lock_guard<std::mutex> lock(m_pool_mutex);
+    if (!m_pool.empty()) {
+      Interpreter interp = std::move(m_pool.back());
+      m_pool.pop_back();
+      return interp;
+    }
+  }
+  return m_startup.clone();
+}
+
+std::shared_ptr<Server::Session> Server::session(const std::string & name) {
+  {
+    std::lock_guard<std::mutex> lock(m_sessions_mutex);
+    std::map<std::string, std::shared_ptr<Session>>::iterator found = m_sessions.find(name);
+    if (found != m_sessions.end()) return found->second;
+  }
+  // copy outside the lock, the first of two requests making the session wins
+  std::shared_ptr<Session> made = std::make_shared<Session>(take());
+  std::lock_guard<std::mutex> lock(m_sessions_mutex);
+  return m_sessions.insert(std::make_pair(name, made)).first->second;
+}
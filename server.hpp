@@ -0,0 +1,141 @@
+/*! \file server.hpp
+Defines the server, which answers programs sent over a local socket from
+interpreters cloned from one evaluated startup environment.
+ */
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "interpreter.hpp"
+#include "cancel.hpp"
+
+/*! \struct ServerReply
+\brief The answer to one request.
+ */
+struct ServerReply {
+
+  ServerReply(): ok(false) {}
+
+  /// true if the program parsed and evaluated without error
+  bool ok;
+
+  /// the printed result, or the error message when ok is false
+  std::string output;
+};
+
+/*! \class Server
+\brief Evaluates programs sent over a Unix domain socket.
+
+A request is a header line naming the session, a space and then either the
+program itself, ending at the newline, or # and the length in bytes of the
+program that follows the newline:
+
+    - (+ 1 2)
+    work #22
+    (define x (list 1 2))
+
+Session names are made of letters, digits, -, _ and . only. The session -
+evaluates on a fresh clone of the startup interpreter, taken from a pool of
+clones made ahead of time. Any other name evaluates on a session that keeps
+its definitions between requests, from any connection, and is made on first
+use. The program %close forgets a named session. Every clone has its own
+memo cache, so no request or session sees or clears the results of another.
+
+Every request is answered, in order, with ok or error, a space, the length
+of the output in bytes and a newline, then the output and a newline:
+
+    ok 3
+    (3)
+
+Each connection is served on its own thread. Requests to the same named
+session run one at a time, others run concurrently, all under the limits
+set on the startup interpreter.
+ */
+class Server {
+public:
+
+  /*! Construct a server whose sessions start from startup.
+    \param startup the interpreter sessions are cloned from
+    \param warm the number of fresh copies kept ready for - requests
+   */
+  explicit Server(const Interpreter & startup, std::size_t warm = 2);
+
+  /// stop serving and remove the socket
+  ~Server();
+
+  /*! Listen on a socket at path, replacing a socket left there by an
+    earlier server.
+    \throws std::runtime_error if the socket cannot be made
+   */
+  void listen(const std::string & path);
+
+  /// accept and serve connections until stop() is called or Cntl-C is
+  /// pressed, then cancel running requests and close every connection
+  void run();
+
+  /// make run() return, safe to call from any thread
+  void stop() noexcept;
+
+  /// evaluate program on session as a request over the socket would
+  ServerReply handle(const std::string & session, const std::string & program);
+
+  /// make fresh copies until the pool is full again
+  void refill();
+
+  /// the number of named sessions
+  std::size_t sessions() const;
+
+  /// false where the server is not supported
+  static bool supported() noexcept;
+
+private:
+
+  // a named session, requests to it run one at a time
+  struct Session {
+    Session(Interpreter && start): interp(std::move(start)) {}
+
+    std::mutex mutex;
+    Interpreter interp;
+  };
+
+  // a fresh clone of the startup interpreter, from the pool if it has one
+  Interpreter take();
+
+  // the named session, made on first use
+  std::shared_ptr<Session> session(const std::string & name);
+
+  // answer requests on the connected socket until it closes
+  void serve(int fd);
+
+  Interpreter m_startup;
+  std::size_t m_warm;
+
+  std::mutex m_pool_mutex;
+  std::vector<Interpreter> m_pool;
+
+  mutable std::mutex m_sessions_mutex;
+  std::map<std::string, std::shared_ptr<Session>> m_sessions;
+
+  // the open connections and the threads serving them
+  std::mutex m_connections_mutex;
+  std::condition_variable m_connections_done;
+  std::set<int> m_connections;
+
+  std::string m_path;
+  int m_listener;
+  std::atomic<bool> m_stop;
+
+  // cancels every running request once the server stops
+  CancelToken m_token;
+};
+
+#endif
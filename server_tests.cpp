@@ -0,0 +1,166 @@
+#include "catch.hpp"
+
+#include "server.hpp"
+#include "interpreter.hpp"
+
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cstring>
+
+// a blocking client for the server's protocol
+class Client {
+public:
+	explicit Client(const std::string & path) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		sockaddr_un address;
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+		connected = connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+	}
+
+	~Client() {
+		close(fd);
+	}
+
+	void send(const std::string & text) {
+		::send(fd, text.data(), text.size(), 0);
+	}
+
+	// the next reply as "ok (3)" or "error ...", empty if the socket closed
+	std::string reply() {
+		std::string header;
+		char c;
+		while (recv(fd, &c, 1, 0) == 1 && c != '\n') {
+			header += c;
+		}
+		std::istringstream words(header);
+		std::string status;
+		std::size_t length;
+		if (!(words >> status >> length)) {
+			return "";
+		}
+		std::string output(length + 1, '\0');
+		std::size_t got = 0;
+		while (got < output.size()) {
+			ssize_t n = recv(fd, &output[got], output.size() - got, 0);
+			if (n <= 0) return "";
+			got += n;
+		}
+		output.pop_back();
+		return status + " " + output;
+	}
+
+	int fd;
+	bool connected;
+};
+
+TEST_CASE("Test serving fresh and named sessions over a socket", "[server]") {
+	Interpreter startup;
+	std::istringstream definitions("(define twice (lambda (x) (* 2 x)))");
+	REQUIRE(startup.parseStream(definitions));
+	startup.evaluate();
+
+	Server server(startup);
+	server.listen("server_tests.sock");
+	std::thread running(&Server::run, &server);
+
+	{
+		Client client("server_tests.sock");
+		REQUIRE(client.connected);
+
+		// fresh sessions start from startup and forget their definitions
+		client.send("- (twice 21)\n");
+		REQUIRE(client.reply() == "ok (42)");
+		client.send("- (define y 1)\n");
+		REQUIRE(client.reply() == "ok (1)");
+		client.send("- (+ y 0)\n");
+		REQUIRE(client.reply() == "error Error during evaluation: unknown symbol");
+
+		// named sessions keep them, and programs may span lines when their
+		// length is given
+		std::string program = "(define y\n  (twice 2))";
+		client.send("work #" + std::to_string(program.size()) + "\n" + program);
+		REQUIRE(client.reply() == "ok (4)");
+		client.send("work (+ y 1)\n");
+		REQUIRE(client.reply() == "ok (5)");
+
+		// from any connection
+		Client other("server_tests.sock");
+		other.send("work (+ y 0)\n");
+		REQUIRE(other.reply() == "ok (4)");
+		REQUIRE(server.sessions() == 1);
+		other.send("work %close\n");
+		REQUIRE(other.reply() == "ok closed work");
+		other.send("work (+ y 0)\n");
+		REQUIRE(other.reply() == "error Error during evaluation: unknown symbol");
+
+		client.send("- (+ 1\n");
+		REQUIRE(client.reply() == "error Error: Invalid Program. Could not parse.");
+		client.send("(+ 1 2)\n");
+		REQUIRE(client.reply() == "error Error: request must start with a session name and a space");
+	}
+
+	server.stop();
+	running.join();
+}
+
+TEST_CASE("Test stopping the server cancels running requests", "[server]") {
+	Interpreter startup;
+	Server server(startup);
+	server.listen("server_tests.sock");
+	std::thread running(&Server::run, &server);
+
+	Client client("server_tests.sock");
+	REQUIRE(client.connected);
+	client.send("- (fold-range + 0 0 1e12 1)\n");
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	server.stop();
+	REQUIRE(client.reply() == "error Error: interpreter kernel interrupted");
+	// then the connection closes
+	REQUIRE(client.reply() == "");
+	running.join();
+}
+
+#endif
+
+TEST_CASE("Test handling requests without a socket", "[server]") {
+	Interpreter startup;
+	Server server(startup, 1);
+
+	ServerReply reply = server.handle("-", "(+ 1 2)");
+	REQUIRE(reply.ok);
+	REQUIRE(reply.output == "(3)");
+
+	reply = server.handle("s", "(define a 2)");
+	REQUIRE(reply.ok);
+	reply = server.handle("s", "(* a a)");
+	REQUIRE(reply.ok);
+	REQUIRE(reply.output == "(4)");
+
+	reply = server.handle("t", "%close");
+	REQUIRE(!reply.ok);
+	REQUIRE(reply.output == "Error: no session named t");
+}
+
+TEST_CASE("Test sessions do not share memoized results", "[server]") {
+	Interpreter startup;
+	startup.setAutoMemoize(true);
+	Server server(startup, 2);
+
+	// each session and fresh request counts only its own calls
+	std::string program = "(begin (define sq (lambda (x) (* x x))) (sq 3) (sq 3) (first (memo-stats)))";
+	for (auto name : { "s", "t", "-", "-" }) {
+		INFO(name);
+		ServerReply reply = server.handle(name, program);
+		REQUIRE(reply.ok);
+		REQUIRE(reply.output == "(1)");
+	}
+	REQUIRE(startup.memoStats().entries == 0);
+}
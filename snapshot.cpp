@@ -0,0 +1,195 @@
+#include "snapshot.hpp"
+
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+#include "semantic_error.hpp"
+
+namespace {
+
+// the expression starting at node, leaving node just past it
+Expression read(const SnapshotNode *& node) {
+  const SnapshotNode & top = *node++;
+
+  Atom head;
+  switch (top.kind) {
+  case SnapshotNumber:
+    head = Atom(top.real);
+    break;
+  case SnapshotSymbol:
+  case SnapshotString:
+    head = Atom(std::string(top.text));
+    break;
+  case SnapshotComplex:
+    head = Atom(std::complex<double>(top.real, top.imag));
+    break;
+  case SnapshotList:
+    head.setList();
+    break;
+  case SnapshotLambda:
+    head.setLambda();
+    break;
+  case SnapshotDiscrete:
+    head.setDiscrete();
+    break;
+  default:
+    break;
+  }
+
+  std::vector<Expression> tail;
+  tail.reserve(top.tail);
+  for (std::size_t i = 0; i < top.tail; i++) {
+    tail.push_back(read(node));
+  }
+
+  std::shared_ptr<Expression::PropertyMap> properties;
+  if (top.properties > 0) {
+    properties = std::make_shared<Expression::PropertyMap>();
+    for (std::size_t i = 0; i < top.properties; i++) {
+      std::string key = (node++)->text;
+      (*properties)[key] = read(node);
+    }
+  }
+
+  return Expression::restore(head, std::move(tail), properties, top.purity, top.memoized);
+}
+
+// text as a C++ string literal
+std::string quote(const std::string & text) {
+  std::ostringstream out;
+  out << '"';
+  for (unsigned char c : text) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    }
+    else if (c < 32 || c > 126) {
+      // three octal digits, so a following digit is not taken as part of it
+      out << '\\' << std::oct << std::setw(3) << std::setfill('0') << int(c) << std::dec;
+    }
+    else {
+      out << c;
+    }
+  }
+  out << '"';
+  return out.str();
+}
+
+// a double as a C++ constant that reads back to the same value
+std::string literal(double value) {
+  if (std::isnan(value)) {
+    return "std::numeric_limits<double>::quiet_NaN()";
+  }
+  if (std::isinf(value)) {
+    return value > 0 ? "std::numeric_limits<double>::infinity()" : "-std::numeric_limits<double>::infinity()";
+  }
+  std::ostringstream out;
+  out << std::setprecision(std::numeric_limits<double>::max_digits10) << value;
+  return out.str();
+}
+
+const char * const purity_names[] = { "Pure", "ReadsGlobals", "SideEffecting" };
+
+void write_node(std::ostream & out, SnapshotKind kind, double real, double imag, const std::string * text,
+  std::size_t tail, std::size_t properties, Purity purity, bool memoized) {
+  static const char * const kind_names[] = {
+    "SnapshotNone", "SnapshotNumber", "SnapshotSymbol", "SnapshotComplex", "SnapshotList",
+    "SnapshotLambda", "SnapshotString", "SnapshotDiscrete", "SnapshotProperty"
+  };
+  out << "  { " << kind_names[kind] << ", " << literal(real) << ", " << literal(imag) << ", "
+    << (text ? quote(*text) : "nullptr") << ", " << tail << ", " << properties << ", "
+    << purity_names[purity] << ", " << (memoized ? "true" : "false") << " },\n";
+}
+
+// write exp and everything below it in prefix order
+void write(std::ostream & out, const Expression & exp) {
+  const Atom & head = exp.head();
+  SnapshotKind kind = SnapshotNone;
+  double real = 0, imag = 0;
+  std::string text;
+  if (head.isNumber()) {
+    kind = SnapshotNumber;
+    real = head.asNumber();
+  }
+  else if (head.isSymbol()) {
+    kind = SnapshotSymbol;
+    text = head.asSymbol();
+  }
+  else if (head.isString()) {
+    kind = SnapshotString;
+    text = head.asString();
+  }
+  else if (head.isComplex()) {
+    kind = SnapshotComplex;
+    real = head.asComplex().real();
+    imag = head.asComplex().imag();
+  }
+  else if (head.isList()) {
+    kind = SnapshotList;
+  }
+  else if (head.isLambda()) {
+    kind = SnapshotLambda;
+  }
+  else if (head.isDiscrete()) {
+    kind = SnapshotDiscrete;
+  }
+  else if (head.isFuture()) {
+    throw SemanticError("Error during evaluation: a future cannot be saved in a snapshot");
+  }
+
+  std::shared_ptr<const Expression::PropertyMap> properties = exp.properties();
+  write_node(out, kind, real, imag, kind == SnapshotSymbol || kind == SnapshotString ? &text : nullptr,
+    exp.tailSize(), properties ? properties->size() : 0, exp.purity(), exp.memoized());
+  for (auto e = exp.tailConstBegin(); e != exp.tailConstEnd(); ++e) {
+    write(out, *e);
+  }
+  if (properties) {
+    for (auto & property : *properties) {
+      write_node(out, SnapshotProperty, 0, 0, &property.first, 0, 0, SideEffecting, false);
+      write(out, property.second);
+    }
+  }
+}
+
+}
+
+void restore_snapshot(const Snapshot & snapshot, Environment & env) {
+  const SnapshotNode * node = snapshot.nodes;
+  for (std::size_t i = 0; i < snapshot.definitions; i++) {
+    env.add_exp(Atom(std::string(snapshot.names[i])), read(node));
+  }
+}
+
+void write_snapshot(std::ostream & out, const Environment & env, const std::string & name) {
+  // only what the startup program defined, the builtins are made by Environment
+  std::map<std::string, Expression> builtins = Environment().expressions();
+  std::vector<std::pair<std::string, Expression>> definitions;
+  for (auto & entry : env.expressions()) {
+    auto builtin = builtins.find(entry.first);
+    if (builtin == builtins.end() || !builtin->second.identical(entry.second)) {
+      definitions.push_back(entry);
+    }
+  }
+
+  std::ostringstream nodes;
+  for (auto & definition : definitions) {
+    write(nodes, definition.second);
+  }
+
+  out << "// written by snapshot_gen, do not edit\n"
+      << "#include \"snapshot.hpp\"\n\n"
+      << "#include <limits>\n\n"
+      << "namespace {\n\n"
+      << "const char * const names[] = {\n";
+  for (auto & definition : definitions) {
+    out << "  " << quote(definition.first) << ",\n";
+  }
+  out << "  nullptr\n};\n\n"
+      << "const SnapshotNode nodes[] = {\n"
+      << nodes.str()
+      << "  { SnapshotNone, 0, 0, nullptr, 0, 0, SideEffecting, false }\n};\n\n"
+      << "}\n\n"
+      << "extern const Snapshot " << name << " = { names, nodes, " << definitions.size() << " };\n";
+}
@@ -0,0 +1,92 @@
+/*! \file snapshot.hpp
+Defines snapshots, the definitions made by a startup program saved as
+static data so an interpreter can start with them without tokenizing,
+parsing or evaluating the program again.
+
+The build runs snapshot_gen on startup.pls to write startup_snapshot.cpp,
+which defines startup_snapshot and is linked into the programs, not the
+interpreter library.
+ */
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+
+#include "environment.hpp"
+#include "purity.hpp"
+
+/*! \enum SnapshotKind
+\brief The kind of the head of a saved expression.
+ */
+enum SnapshotKind {
+  SnapshotNone,
+  SnapshotNumber,
+  SnapshotSymbol,
+  SnapshotComplex,
+  SnapshotList,
+  SnapshotLambda,
+  SnapshotString,
+  SnapshotDiscrete,
+  /// a property key, the value expression follows it
+  SnapshotProperty
+};
+
+/*! \struct SnapshotNode
+\brief One expression of a snapshot, in prefix order.
+
+A node is followed by the nodes of its tail, then by a SnapshotProperty node
+and its value for each property, so a snapshot is an array of constants
+that needs no code to initialize.
+ */
+struct SnapshotNode {
+  /// the kind of head, or a property key
+  SnapshotKind kind;
+  /// the number, or the real part of a complex
+  double real;
+  /// the imaginary part of a complex
+  double imag;
+  /// the symbol, the string with its quotes, or the property key
+  const char * text;
+  /// the number of tail expressions that follow
+  std::size_t tail;
+  /// the number of properties that follow the tail
+  std::size_t properties;
+  /// the classification of a lambda
+  Purity purity;
+  /// true for lambdas made with memoize
+  bool memoized;
+};
+
+/*! \struct Snapshot
+\brief The definitions a startup program made, in symbol order.
+ */
+struct Snapshot {
+  /// the name of each definition
+  const char * const * names;
+  /// the value of each definition, one after the other
+  const SnapshotNode * nodes;
+  /// the number of definitions
+  std::size_t definitions;
+};
+
+/// the definitions of startup.pls, written by snapshot_gen at build time
+extern const Snapshot startup_snapshot;
+
+/*! Add the definitions of snapshot to env, replacing any of the same name.
+  \param snapshot the saved definitions
+  \param env the environment to define them in
+ */
+void restore_snapshot(const Snapshot & snapshot, Environment & env);
+
+/*! Write C++ source defining a Snapshot called name that holds the
+  definitions env has beyond those of a default Environment.
+  \param out where to write the source
+  \param env the environment after the startup program
+  \param name the name of the Snapshot variable
+  \throws SemanticError if a definition cannot be saved, such as a future
+ */
+void write_snapshot(std::ostream & out, const Environment & env, const std::string & name);
+
+#endif
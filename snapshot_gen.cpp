@@ -0,0 +1,45 @@
+// Evaluates a startup program and writes its definitions as C++ source
+// defining startup_snapshot, run by the build on startup.pls.
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+
+int main(int argc, char *argv[])
+{
+	if (argc != 3) {
+		std::cerr << "Usage: snapshot_gen <startup.pls> <output.cpp>" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	Interpreter interp;
+	std::ifstream ifs(argv[1]);
+	if (!ifs) {
+		std::cerr << "Error: Could not open " << argv[1] << " for reading." << std::endl;
+		return EXIT_FAILURE;
+	}
+	if (!interp.parseStream(ifs)) {
+		std::cerr << "Error: Invalid Program. Could not parse " << argv[1] << "." << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::ofstream out(argv[2]);
+	try {
+		interp.evaluate();
+		interp.writeSnapshot(out, "startup_snapshot");
+	}
+	catch (const SemanticError & ex) {
+		std::cerr << argv[1] << ": " << ex.what() << std::endl;
+		out.close();
+		std::remove(argv[2]);
+		return EXIT_FAILURE;
+	}
+	if (!out) {
+		std::cerr << "Error: Could not write " << argv[2] << "." << std::endl;
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,73 @@
+#include "catch.hpp"
+
+#include "snapshot.hpp"
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+#include "startup_config.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+TEST_CASE("Test the built in snapshot matches the startup file", "[snapshot]") {
+	Interpreter evaluated;
+	std::ifstream ifs(STARTUP_FILE);
+	REQUIRE(evaluated.parseStream(ifs));
+	evaluated.evaluate();
+
+	Interpreter restored(startup_snapshot);
+	REQUIRE(startup_snapshot.definitions > 0);
+
+	// the same definitions save to the same source
+	std::ostringstream from_file, from_snapshot;
+	evaluated.writeSnapshot(from_file, "startup_snapshot");
+	restored.writeSnapshot(from_snapshot, "startup_snapshot");
+	REQUIRE(from_file.str() == from_snapshot.str());
+
+	std::istringstream iss("(make-point 1 2)");
+	REQUIRE(restored.parseStream(iss));
+	REQUIRE(restored.evaluate().isPoint());
+}
+
+TEST_CASE("Test restoring expressions from snapshot nodes", "[snapshot]") {
+	const char * const names[] = { "c", "s", "p" };
+	const SnapshotNode nodes[] = {
+		{ SnapshotComplex, 1, -2, nullptr, 0, 0, SideEffecting, false },
+		{ SnapshotString, 0, 0, "\"a b\"", 0, 0, SideEffecting, false },
+		{ SnapshotList, 0, 0, nullptr, 2, 1, SideEffecting, false },
+		{ SnapshotNumber, 3, 0, nullptr, 0, 0, SideEffecting, false },
+		{ SnapshotNumber, 4, 0, nullptr, 0, 0, SideEffecting, false },
+		// keys keep the quotes of the string they were set with
+		{ SnapshotProperty, 0, 0, "\"object-name\"", 0, 0, SideEffecting, false },
+		{ SnapshotString, 0, 0, "\"point\"", 0, 0, SideEffecting, false },
+	};
+	const Snapshot snapshot = { names, nodes, 3 };
+
+	Interpreter interp(snapshot);
+	std::istringstream iss("(list c s (get-property \"object-name\" p) (first p))");
+	REQUIRE(interp.parseStream(iss));
+	std::ostringstream out;
+	out << interp.evaluate();
+	REQUIRE(out.str() == "((1,-2) (\"a b\") (\"point\") (3))");
+}
+
+TEST_CASE("Test writing a snapshot", "[snapshot]") {
+	Interpreter interp;
+	std::istringstream iss("(begin (define s \"say hi\") (define sq (memoize (lambda (x) (* x x)))))");
+	REQUIRE(interp.parseStream(iss));
+	interp.evaluate();
+
+	std::ostringstream out;
+	interp.writeSnapshot(out, "saved");
+	std::string source = out.str();
+	REQUIRE(source.find("extern const Snapshot saved = { names, nodes, 2 };") != std::string::npos);
+	REQUIRE(source.find("SnapshotLambda") != std::string::npos);
+	REQUIRE(source.find("Pure, true") != std::string::npos);
+	// builtin constants are not saved
+	REQUIRE(source.find("\"pi\"") == std::string::npos);
+
+	std::istringstream future("(define f (spawn (+ 1 2)))");
+	REQUIRE(interp.parseStream(future));
+	interp.evaluate();
+	REQUIRE_THROWS_AS(interp.writeSnapshot(out, "saved"), SemanticError);
+}
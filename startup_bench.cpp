@@ -0,0 +1,70 @@
+/*
+Cold start benchmark for the startup environment.
+
+Times making an interpreter ready for its first program three ways: reading,
+parsing and evaluating startup.pls as plotscript used to, restoring the
+snapshot saved at build time, and copying an interpreter that already has
+the startup definitions, as the batch runner and server do for each request.
+
+usage: startup_bench [N]
+*/
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "interpreter.hpp"
+#include "semantic_error.hpp"
+#include "startup_config.hpp"
+
+// average microseconds per call of make over n calls
+template <typename Make>
+static double measure(std::size_t n, Make make) {
+	Interpreter interp = make();
+	std::istringstream iss("(make-point 1 2)");
+	if (!interp.parseStream(iss) || !interp.evaluate().isPoint()) {
+		std::cerr << "The startup definitions are missing" << std::endl;
+		std::exit(EXIT_FAILURE);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (std::size_t i = 0; i < n; i++) {
+		Interpreter made = make();
+	}
+	auto stop = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::micro>(stop - start).count() / n;
+}
+
+int main(int argc, char *argv[]) {
+	std::size_t n = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 2000;
+	if (n == 0) n = 1;
+
+	double evaluated = measure(n, [] {
+		Interpreter interp;
+		std::ifstream ifs(STARTUP_FILE);
+		if (!interp.parseStream(ifs)) {
+			std::cerr << "Could not parse " << STARTUP_FILE << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+		interp.evaluate();
+		return interp;
+	});
+
+	double restored = measure(n, [] {
+		return Interpreter(startup_snapshot);
+	});
+
+	const Interpreter base(startup_snapshot);
+	double copied = measure(n, [&base] {
+		return base;
+	});
+
+	std::cout << "startup.pls evaluated: " << evaluated << " us" << std::endl;
+	std::cout << "snapshot restored:     " << restored << " us" << std::endl;
+	std::cout << "startup copied:        " << copied << " us" << std::endl;
+
+	// the snapshot has to beat doing the work at run time
+	return restored < evaluated ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,81 @@
+/*! \file symbol_table.hpp
+Defines the flat hash table environments keep their symbols in.
+ */
+#ifndef SYMBOL_TABLE_HPP
+#define SYMBOL_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*! \class SymbolTable
+\brief A map from symbol names to T stored in two flat arrays.
+
+The entries are kept densely, in no particular order, with the hash of their
+name worked out when they are added. An open addressing index of entry
+numbers, probed linearly, finds them, so a lookup compares hashes and only
+compares a name when the hashes match. Copying a table copies two arrays.
+ */
+template<typename T>
+class SymbolTable
+{
+public:
+
+	/// Construct an empty table
+	SymbolTable();
+
+	/// the hash of a name, as stored with its entry
+	static std::uint64_t hash(const std::string & name) noexcept;
+
+	/// the value stored for name, or nullptr
+	const T * find(const std::string & name) const noexcept;
+
+	/// the value stored for name, whose hash is h, or nullptr
+	const T * find(const std::string & name, std::uint64_t h) const noexcept;
+
+	/// store value for name, replacing any value it had
+	void assign(const std::string & name, const T & value);
+
+	/// remove name, false if it was not stored
+	bool erase(const std::string & name);
+
+	/// remove every entry
+	void clear() noexcept;
+
+	/// the number of names stored
+	std::size_t size() const noexcept;
+
+	/// call f(name, value) for every entry, in no particular order
+	template<typename F>
+	void forEach(F f) const;
+
+private:
+
+	struct Entry {
+		Entry(std::uint64_t h, const std::string & n, const T & v): hash(h), name(n), value(v) {}
+
+		std::uint64_t hash;
+		std::string name;
+		T value;
+	};
+
+	// index slots hold an entry number plus one, or one of these
+	static const std::uint32_t empty = 0;
+	static const std::uint32_t removed = 0xffffffffu;
+
+	// the index slot holding name, or the slot it would go in, and whether
+	// it was found
+	std::size_t probe(const std::string & name, std::uint64_t h, bool & found) const noexcept;
+
+	// rebuild the index with capacity slots, dropping removed markers
+	void rehash(std::size_t capacity);
+
+	std::vector<Entry> m_entries;
+	std::vector<std::uint32_t> m_index;
+	std::size_t m_removed;
+};
+
+#include "symbol_table.tpp"
+
+#endif
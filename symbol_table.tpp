@@ -0,0 +1,145 @@
+#include "symbol_table.hpp"
+
+#include <utility>
+
+template<typename T>
+const std::uint32_t SymbolTable<T>::empty;
+
+template<typename T>
+const std::uint32_t SymbolTable<T>::removed;
+
+template<typename T>
+SymbolTable<T>::SymbolTable(): m_removed(0) {}
+
+// 64 bit FNV-1a
+template<typename T>
+std::uint64_t SymbolTable<T>::hash(const std::string & name) noexcept {
+	std::uint64_t h = 14695981039346656037ull;
+	for (unsigned char c : name) {
+		h ^= c;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+template<typename T>
+const T * SymbolTable<T>::find(const std::string & name) const noexcept {
+	return find(name, hash(name));
+}
+
+template<typename T>
+const T * SymbolTable<T>::find(const std::string & name, std::uint64_t h) const noexcept {
+	if (m_entries.empty()) {
+		return nullptr;
+	}
+	bool found;
+	std::size_t slot = probe(name, h, found);
+	return found ? &m_entries[m_index[slot] - 1].value : nullptr;
+}
+
+template<typename T>
+void SymbolTable<T>::assign(const std::string & name, const T & value) {
+	// keep at least half the slots empty so probes stay short and end
+	if (2 * (m_entries.size() + m_removed + 1) > m_index.size()) {
+		std::size_t capacity = 8;
+		while (capacity < 4 * (m_entries.size() + 1)) {
+			capacity *= 2;
+		}
+		rehash(capacity);
+	}
+
+	std::uint64_t h = hash(name);
+	bool found;
+	std::size_t slot = probe(name, h, found);
+	if (found) {
+		m_entries[m_index[slot] - 1].value = value;
+		return;
+	}
+	m_entries.emplace_back(h, name, value);
+	if (m_index[slot] == removed) {
+		--m_removed;
+	}
+	m_index[slot] = static_cast<std::uint32_t>(m_entries.size());
+}
+
+template<typename T>
+bool SymbolTable<T>::erase(const std::string & name) {
+	if (m_entries.empty()) {
+		return false;
+	}
+	bool found;
+	std::size_t slot = probe(name, hash(name), found);
+	if (!found) {
+		return false;
+	}
+	std::size_t at = m_index[slot] - 1;
+	m_index[slot] = removed;
+	++m_removed;
+
+	// the last entry fills the gap, so the entries stay dense
+	std::size_t last = m_entries.size() - 1;
+	if (at != last) {
+		std::size_t moved = probe(m_entries[last].name, m_entries[last].hash, found);
+		m_index[moved] = static_cast<std::uint32_t>(at + 1);
+		m_entries[at] = std::move(m_entries[last]);
+	}
+	m_entries.pop_back();
+	return true;
+}
+
+template<typename T>
+void SymbolTable<T>::clear() noexcept {
+	m_entries.clear();
+	m_index.clear();
+	m_removed = 0;
+}
+
+template<typename T>
+std::size_t SymbolTable<T>::size() const noexcept {
+	return m_entries.size();
+}
+
+template<typename T>
+template<typename F>
+void SymbolTable<T>::forEach(F f) const {
+	for (const Entry & entry : m_entries) {
+		f(entry.name, entry.value);
+	}
+}
+
+template<typename T>
+std::size_t SymbolTable<T>::probe(const std::string & name, std::uint64_t h, bool & found) const noexcept {
+	std::size_t mask = m_index.size() - 1;
+	std::size_t reuse = m_index.size();
+	for (std::size_t slot = h & mask; ; slot = (slot + 1) & mask) {
+		std::uint32_t at = m_index[slot];
+		if (at == empty) {
+			found = false;
+			// a new entry takes the first removed slot on the way
+			return reuse < m_index.size() ? reuse : slot;
+		}
+		if (at == removed) {
+			if (reuse == m_index.size()) {
+				reuse = slot;
+			}
+		}
+		else if (m_entries[at - 1].hash == h && m_entries[at - 1].name == name) {
+			found = true;
+			return slot;
+		}
+	}
+}
+
+template<typename T>
+void SymbolTable<T>::rehash(std::size_t capacity) {
+	m_index.assign(capacity, empty);
+	m_removed = 0;
+	std::size_t mask = capacity - 1;
+	for (std::size_t i = 0; i < m_entries.size(); i++) {
+		std::size_t slot = m_entries[i].hash & mask;
+		while (m_index[slot] != empty) {
+			slot = (slot + 1) & mask;
+		}
+		m_index[slot] = static_cast<std::uint32_t>(i + 1);
+	}
+}
@@ -0,0 +1,74 @@
+#include "catch.hpp"
+
+#include <map>
+#include <random>
+#include <string>
+
+#include "symbol_table.hpp"
+
+TEST_CASE("Test assigning, finding and erasing symbols", "[symbol_table]") {
+	SymbolTable<int> table;
+	REQUIRE(table.find("x") == nullptr);
+	REQUIRE(!table.erase("x"));
+
+	table.assign("x", 1);
+	table.assign("y", 2);
+	table.assign("x", 3);
+	REQUIRE(table.size() == 2);
+	REQUIRE(*table.find("x") == 3);
+	REQUIRE(*table.find("y", SymbolTable<int>::hash("y")) == 2);
+
+	// erasing the first entry moves the last one into its place
+	REQUIRE(table.erase("x"));
+	REQUIRE(table.find("x") == nullptr);
+	REQUIRE(*table.find("y") == 2);
+	REQUIRE(table.size() == 1);
+
+	table.clear();
+	REQUIRE(table.size() == 0);
+	REQUIRE(table.find("y") == nullptr);
+	table.assign("y", 4);
+	REQUIRE(*table.find("y") == 4);
+}
+
+TEST_CASE("Test the symbol table agrees with std::map", "[symbol_table]") {
+	SymbolTable<int> table;
+	std::map<std::string, int> reference;
+	std::mt19937 random(42);
+
+	// few names, so names are erased and assigned again many times
+	for (int i = 0; i < 20000; i++) {
+		std::string name = "s" + std::to_string(random() % 300);
+		if (random() % 3 == 0) {
+			REQUIRE(table.erase(name) == (reference.erase(name) > 0));
+		}
+		else {
+			table.assign(name, i);
+			reference[name] = i;
+		}
+	}
+
+	REQUIRE(table.size() == reference.size());
+	for (int i = 0; i < 300; i++) {
+		std::string name = "s" + std::to_string(i);
+		const int * found = table.find(name);
+		auto expected = reference.find(name);
+		REQUIRE((found != nullptr) == (expected != reference.end()));
+		if (found) {
+			REQUIRE(*found == expected->second);
+		}
+	}
+
+	std::size_t visited = 0;
+	table.forEach([&](const std::string & name, int value) {
+		REQUIRE(reference.at(name) == value);
+		++visited;
+	});
+	REQUIRE(visited == reference.size());
+
+	// copies are independent
+	SymbolTable<int> copy = table;
+	copy.assign("new", 1);
+	REQUIRE(table.find("new") == nullptr);
+	REQUIRE(*copy.find("new") == 1);
+}
@@ -0,0 +1,235 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#include "budget.hpp"
+
+// the pool and queue of the worker running on this thread, if any
+static thread_local ThreadPool * current_pool = nullptr;
+static thread_local unsigned current_index = 0;
+
+ThreadPool & ThreadPool::shared() {
+  static ThreadPool pool(std::thread::hardware_concurrency());
+  return pool;
+}
+
+ThreadPool::ThreadPool(unsigned workers): done(false), next(0), pending(0) {
+
+  if (workers == 0) workers = 1;
+
+  for (unsigned i = 0; i < workers; ++i) {
+    queues.emplace_back(new WorkQueue);
+  }
+  for (unsigned i = 0; i < workers; ++i) {
+    threads.emplace_back(&ThreadPool::work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    // a task waiting on a group would otherwise keep its worker, and the
+    // process exiting, waiting for as long as the group runs
+    std::lock_guard<std::mutex> lock(groups_mutex);
+    for (TaskGroup * group : groups) {
+      group->cancel();
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    done = true;
+  }
+  sleep_condition.notify_all();
+  for (auto & t : threads) {
+    t.join();
+  }
+}
+
+unsigned ThreadPool::size() const noexcept {
+  return static_cast<unsigned>(threads.size());
+}
+
+void ThreadPool::submit(Task task, const void * owner) {
+
+  // the task runs under the cancellation token and budget of the code
+  // submitting it
+  CancelToken token = CancelToken::current();
+  std::shared_ptr<Budget> budget = Budget::current();
+  if (token || budget) {
+    Task inner = std::move(task);
+    task = [token, budget, inner]() {
+      CancelScope scope(token);
+      BudgetScope limits(budget);
+      inner();
+    };
+  }
+
+  unsigned index = (current_pool == this) ? current_index : (next++ % size());
+  {
+    std::lock_guard<std::mutex> lock(queues[index]->mutex);
+    queues[index]->tasks.push_back(Job{ owner, std::move(task) });
+  }
+  {
+    // taking the lock orders the increment with a worker going to sleep
+    std::lock_guard<std::mutex> lock(sleep_mutex);
+    ++pending;
+  }
+  sleep_condition.notify_one();
+}
+
+bool ThreadPool::run_one(const void * owner) {
+
+  Task task;
+  unsigned index = (current_pool == this) ? current_index : 0;
+  if (take(index, owner, task)) {
+    task();
+    return true;
+  }
+  return false;
+}
+
+bool ThreadPool::pop(unsigned index, Task & task) {
+
+  std::lock_guard<std::mutex> lock(queues[index]->mutex);
+  if (queues[index]->tasks.empty()) {
+    return false;
+  }
+  task = std::move(queues[index]->tasks.back().task);
+  queues[index]->tasks.pop_back();
+  --pending;
+  return true;
+}
+
+bool ThreadPool::steal(unsigned index, Task & task) {
+
+  for (unsigned i = 1; i <= size(); ++i) {
+    WorkQueue & victim = *queues[(index + i) % size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front().task);
+      victim.tasks.pop_front();
+      --pending;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::take(unsigned index, const void * owner, Task & task) {
+
+  for (unsigned i = 0; i < size(); ++i) {
+    WorkQueue & queue = *queues[(index + i) % size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    for (auto job = queue.tasks.rbegin(); job != queue.tasks.rend(); ++job) {
+      if (job->owner == owner) {
+        task = std::move(job->task);
+        queue.tasks.erase(std::next(job).base());
+        --pending;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void ThreadPool::work(unsigned index) {
+
+  current_pool = this;
+  current_index = index;
+
+  while (true) {
+    Task task;
+    if (pop(index, task) || steal(index, task)) {
+      task();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex);
+    sleep_condition.wait(lock, [this]() { return done || pending > 0; });
+    if (done && pending == 0) {
+      return;
+    }
+  }
+}
+
+TaskGroup::TaskGroup(ThreadPool & pool):
+  m_pool(pool), m_token(CancelToken::current().child()), remaining(0) {
+
+  std::lock_guard<std::mutex> lock(m_pool.groups_mutex);
+  m_pool.groups.push_back(this);
+}
+
+TaskGroup::~TaskGroup() {
+  cancel();
+  join();
+  std::lock_guard<std::mutex> lock(m_pool.groups_mutex);
+  m_pool.groups.erase(std::find(m_pool.groups.begin(), m_pool.groups.end(), this));
+}
+
+void TaskGroup::run(ThreadPool::Task task) {
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++remaining;
+  }
+  // submit runs the task under the token current here
+  CancelScope scope(m_token);
+  m_pool.submit([this, task]() {
+    try {
+      task();
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+      m_token.cancel();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--remaining == 0) {
+      finished.notify_all();
+    }
+  }, this);
+}
+
+void TaskGroup::wait() {
+
+  join();
+  std::exception_ptr first;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::swap(first, error);
+  }
+  if (first) {
+    std::rethrow_exception(first);
+  }
+}
+
+void TaskGroup::cancel() noexcept {
+  m_token.cancel();
+}
+
+bool TaskGroup::cancelled() const noexcept {
+  return m_token.cancelled();
+}
+
+void TaskGroup::join() {
+
+  while (true) {
+    {
+      // remaining is only read under the lock, so once it reads zero the
+      // last task has released the mutex and the group may be destroyed
+      std::lock_guard<std::mutex> lock(mutex);
+      if (remaining == 0) {
+        return;
+      }
+    }
+    // help with our own queued tasks, a task of another group could keep
+    // this thread busy long after the group finished
+    if (m_pool.run_one(this)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait_for(lock, std::chrono::milliseconds(1), [this]() { return remaining == 0; });
+  }
+}
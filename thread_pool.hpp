@@ -0,0 +1,151 @@
+/*! \file thread_pool.hpp
+Defines the work-stealing thread pool shared by the parallel parts of the
+interpreter, and TaskGroup for waiting on a batch of tasks.
+ */
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cancel.hpp"
+
+class TaskGroup;
+
+/*! \class ThreadPool
+\brief A fixed set of worker threads, each with its own task queue.
+
+A worker takes tasks from the back of its own queue and, when that is empty,
+steals from the front of the other workers' queues. Tasks submitted from a
+worker go to that worker's queue; tasks submitted from any other thread are
+spread over the queues in turn.
+
+Tasks may be tagged with an owner when submitted. A thread waiting on tasks
+it submitted should call run_one() with their owner while it waits, so that
+nested parallel work cannot deadlock the pool. It only ever runs its own
+tasks, never an unrelated long one that would delay its result.
+ */
+class ThreadPool {
+public:
+
+  typedef std::function<void()> Task;
+
+  /// the pool shared by the whole process, one worker per hardware thread
+  static ThreadPool & shared();
+
+  /// Construct a pool with the given number of workers (at least one)
+  explicit ThreadPool(unsigned workers);
+
+  /// cancel the groups still running, then join the workers once they have
+  /// run every queued task, so no task is left waiting on one that was dropped
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool & operator=(const ThreadPool &) = delete;
+
+  /// the number of worker threads
+  unsigned size() const noexcept;
+
+  /// queue a task to be run by some worker, owner tags it for run_one
+  void submit(Task task, const void * owner = nullptr);
+
+  /// run one queued task of owner on the calling thread, false if there was none
+  bool run_one(const void * owner);
+
+private:
+
+  friend class TaskGroup;
+
+  struct Job {
+    const void * owner;
+    Task task;
+  };
+
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Job> tasks;
+  };
+
+  // take a task from the back of queue index
+  bool pop(unsigned index, Task & task);
+
+  // take a task from the front of any queue other than index
+  bool steal(unsigned index, Task & task);
+
+  // take the newest task of owner from any queue, starting at index
+  bool take(unsigned index, const void * owner, Task & task);
+
+  // the loop run by each worker thread
+  void work(unsigned index);
+
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  std::vector<std::thread> threads;
+
+  std::atomic<bool> done;
+  std::atomic<unsigned> next;
+  std::atomic<std::size_t> pending;
+
+  std::mutex sleep_mutex;
+  std::condition_variable sleep_condition;
+
+  // the groups waiting on tasks of this pool, cancelled by the destructor
+  std::mutex groups_mutex;
+  std::vector<TaskGroup *> groups;
+};
+
+/*! \class TaskGroup
+\brief A batch of tasks on a ThreadPool that is waited on as a whole.
+
+The tasks run under a child of the token current when the group was made.
+The first exception thrown by a task is kept and rethrown by wait(); once a
+task has failed, the group is cancelled so its other tasks stop at their
+next cancellation check.
+ */
+class TaskGroup {
+public:
+
+  /// Construct an empty group running on pool
+  explicit TaskGroup(ThreadPool & pool);
+
+  /// waits for any tasks still running, discarding their errors
+  ~TaskGroup();
+
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup & operator=(const TaskGroup &) = delete;
+
+  /// submit a task belonging to this group
+  void run(ThreadPool::Task task);
+
+  /// help run the group's tasks until they all finished, then rethrow the first error
+  void wait();
+
+  /// ask the tasks of the group to stop early
+  void cancel() noexcept;
+
+  /// true once a task failed, cancel was called or the evaluation that made
+  /// the group was cancelled
+  bool cancelled() const noexcept;
+
+private:
+
+  // wait for the tasks without rethrowing
+  void join();
+
+  ThreadPool & m_pool;
+  CancelToken m_token;
+
+  // remaining and error are guarded by mutex
+  std::mutex mutex;
+  std::size_t remaining;
+  std::condition_variable finished;
+  std::exception_ptr error;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "catch.hpp"
+
+#include "thread_pool.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+TEST_CASE("Test task group runs every task", "[thread_pool]") {
+	ThreadPool pool(3);
+	REQUIRE(pool.size() == 3);
+
+	std::atomic<int> count(0);
+	TaskGroup group(pool);
+	for (int i = 0; i < 100; i++) {
+		group.run([&count]() { ++count; });
+	}
+	group.wait();
+	REQUIRE(count == 100);
+}
+
+TEST_CASE("Test nested task groups do not deadlock", "[thread_pool]") {
+	ThreadPool pool(1);
+
+	std::atomic<int> count(0);
+	TaskGroup outer(pool);
+	for (int i = 0; i < 4; i++) {
+		outer.run([&pool, &count]() {
+			TaskGroup inner(pool);
+			for (int j = 0; j < 4; j++) {
+				inner.run([&count]() { ++count; });
+			}
+			inner.wait();
+		});
+	}
+	outer.wait();
+	REQUIRE(count == 16);
+}
+
+TEST_CASE("Test task group rethrows the first error and cancels", "[thread_pool]") {
+	ThreadPool pool(2);
+
+	TaskGroup group(pool);
+	group.run([]() { throw std::runtime_error("failed"); });
+	for (int i = 0; i < 10; i++) {
+		group.run([]() {});
+	}
+	REQUIRE_THROWS_AS(group.wait(), std::runtime_error);
+	REQUIRE(group.cancelled());
+
+	// the error is only reported once
+	REQUIRE_NOTHROW(group.wait());
+}
+
+TEST_CASE("Test destroying the pool cancels groups still running", "[thread_pool]") {
+	std::unique_ptr<ThreadPool> pool(new ThreadPool(2));
+	std::atomic<bool> started(false);
+	std::atomic<bool> stopped(false);
+
+	// a task waiting on a group whose task only ends once cancelled, as an
+	// evaluation still running at exit would
+	pool->submit([&pool, &started, &stopped]() {
+		TaskGroup group(*pool);
+		group.run([&started]() {
+			started = true;
+			while (!cancellation_requested()) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		});
+		group.wait();
+		stopped = true;
+	});
+	while (!started) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	pool.reset();
+	REQUIRE(stopped);
+}
+
+TEST_CASE("Test destroying the pool runs the tasks still queued", "[thread_pool]") {
+	std::atomic<int> count(0);
+	{
+		ThreadPool pool(1);
+		for (int i = 0; i < 100; i++) {
+			pool.submit([&count]() { ++count; });
+		}
+	}
+	REQUIRE(count == 100);
+}
+
+TEST_CASE("Test helping only runs the tasks of one owner", "[thread_pool]") {
+	ThreadPool pool(1);
+
+	// keep the only worker busy so the tasks below stay queued
+	std::atomic<bool> release(false);
+	std::atomic<bool> busy(false);
+	pool.submit([&release, &busy]() {
+		busy = true;
+		while (!release) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	});
+	while (!busy) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	int mine = 0;
+	int theirs = 0;
+	std::atomic<int> ran(0);
+	pool.submit([&ran]() { ++ran; }, &theirs);
+	pool.submit([&ran]() { ++ran; }, &mine);
+	REQUIRE(pool.run_one(&mine));
+	REQUIRE(ran == 1);
+	REQUIRE_FALSE(pool.run_one(&mine));
+	REQUIRE(ran == 1);
+	REQUIRE(pool.run_one(&theirs));
+	REQUIRE(ran == 2);
+	release = true;
+}